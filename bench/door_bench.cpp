@@ -0,0 +1,489 @@
+// Benchmarks for the badge-to-unlock path: microbenchmarks for each stage
+// and a macro benchmark that runs whole doors on the simulated GPIO backend.
+//
+//   door_bench --benchmark_format=json --benchmark_out=door_bench.json
+//
+// The macro benchmark reports edge-to-relay latency percentiles and events
+// per second as counters, so they land in the JSON output next to the
+// timings and can be compared between releases.
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "core/event_loop.hpp"
+#include "core/simulated_gpio_backend.hpp"
+#include "door/anti_passback.hpp"
+#include "door/door.hpp"
+#include "door/door_event_bus.hpp"
+#include "door/wiegand_formats.hpp"
+#include "mqtt/mqtt_client.hpp"
+#include "utils/payload_writer.hpp"
+#include "utils/logger.hpp"
+#include "access/audit_journal.hpp"
+#include "access/credential_store.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    // Lock relay lines, relative to a door's first pin
+    constexpr unsigned int kPinsPerDoor = 8;
+    constexpr unsigned int kSetPin = 5;
+    constexpr unsigned int kUnsetPin = 6;
+
+    // The decoder's idle wait before it calls a frame complete
+    constexpr std::chrono::milliseconds kFrameGap{50};
+
+    // Distinct 34-bit cards in random order. Different seeds never share a card.
+    std::vector<uint64_t> makeCards(size_t count, uint32_t seed)
+    {
+        std::vector<uint64_t> cards(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t id = static_cast<uint32_t>(i) + (seed << 28);
+            cards[i] = Wiegand34::encode(id >> 16, id & 0xffff);
+        }
+        std::shuffle(cards.begin(), cards.end(), std::mt19937_64(seed));
+        return cards;
+    }
+
+    CardReadEvent makeReadEvent(uint64_t card)
+    {
+        WiegandFrame frame;
+        frame.bits = card;
+        frame.length = 34;
+        WiegandCard decoded;
+        WiegandFormats::decode(frame, decoded);
+        return {decoded.raw, decoded.length, decoded.format, decoded.facilityCode,
+            decoded.cardNumber, decoded.parityValid(), std::chrono::system_clock::now(),
+            std::chrono::steady_clock::now()};
+    }
+
+    // Doors on the simulated backend sharing one loop, broker connection and
+    // credential table, as in the controller. The broker is never connected,
+    // so publishes go through the offline queue.
+    struct Site
+    {
+        explicit Site(unsigned int doorCount, const std::vector<uint64_t>& enrolled,
+            std::chrono::milliseconds relockDelay = std::chrono::milliseconds(5000),
+            bool withAudit = false)
+            : loop(std::make_shared<EventLoop>())
+            , backend(std::make_shared<SimulatedGpioBackend>())
+            , gpio(std::make_shared<GpioChipRegistry>(backend))
+            , mqtt(std::make_shared<MqttClient>("door_bench"))
+            , credentials(std::make_shared<CredentialStore>())
+        {
+            CredentialTable::Builder builder;
+            for (uint64_t card : enrolled)
+            {
+                builder.add(card, ~AccessMask{0}, "Bench User");
+            }
+            credentials->replace(builder.build());
+
+            if (withAudit)
+            {
+                AuditJournal::Options options;
+                options.directory = (std::filesystem::temp_directory_path() / "door_bench_journal").string();
+                options.maxSegments = 4;
+                options.sync = AuditJournal::SyncPolicy::OsManaged;
+                std::filesystem::remove_all(options.directory);
+                audit = std::make_shared<AuditJournal>(options);
+            }
+
+            // Door loggers are registered by name, so every site gets fresh ids
+            static std::atomic<unsigned int> siteCount{0};
+            unsigned int site = siteCount++;
+
+            // The observer has to be in place before the relays are requested
+            backend->onOutputChange([this](const std::string&, unsigned int offset, int value)
+            {
+                if (onRelay && offset % kPinsPerDoor == kUnsetPin)
+                {
+                    onRelay(offset / kPinsPerDoor, value);
+                }
+                else if (onLock && offset % kPinsPerDoor == kSetPin && value == 0)
+                {
+                    onLock(offset / kPinsPerDoor);
+                }
+            });
+
+            for (unsigned int i = 0; i < doorCount; i++)
+            {
+                unsigned int base = i * kPinsPerDoor;
+                DoorConfig config
+                {
+                    .doorId = "bench-" + std::to_string(site) + "-" + std::to_string(i),
+                    .reader = {base, base + 1},
+                    .doorSensor = {base + 2, false},
+                    .proximitySensor = {base + 3, false},
+                    .exitButton = {base + 4, false},
+                    .lock = {base + kSetPin, base + kUnsetPin},
+                    .relockDelay = relockDelay
+                };
+                doors.push_back(std::make_unique<Door>(config, mqtt, loop, gpio, credentials, audit));
+            }
+            for (auto& door : doors)
+            {
+                if (!door->initialize())
+                {
+                    throw std::runtime_error("Failed to initialize " + door->id());
+                }
+            }
+
+            // Claim the loop for this thread and let the initial lock pulses finish
+            loop->runOnce(0);
+            auto settle = Clock::now() + std::chrono::milliseconds(100);
+            while (Clock::now() < settle)
+            {
+                loop->runOnce(10);
+            }
+        }
+
+        ~Site()
+        {
+            onRelay = nullptr;
+            onLock = nullptr;
+            for (auto& door : doors)
+            {
+                door->cleanup();
+            }
+        }
+
+        std::shared_ptr<EventLoop> loop;
+        std::shared_ptr<SimulatedGpioBackend> backend;
+        std::shared_ptr<GpioChipRegistry> gpio;
+        std::shared_ptr<MqttClient> mqtt;
+        std::shared_ptr<CredentialStore> credentials;
+        std::shared_ptr<AuditJournal> audit;
+        std::vector<std::unique_ptr<Door>> doors;
+        std::function<void(unsigned int door, int value)> onRelay;
+        std::function<void(unsigned int door)> onLock;
+    };
+
+    double percentile(std::vector<double>& samples, double q)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+        size_t index = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+}
+
+// Assemble a frame bit by bit, as the reader does from edges, and decode it
+static void BM_WiegandDecode(benchmark::State& state)
+{
+    uint8_t length = static_cast<uint8_t>(state.range(0));
+    uint64_t bits = length == 26 ? Wiegand26::encode(42, 12345)
+        : length == 34 ? Wiegand34::encode(4242, 12345)
+        : Wiegand37::encode(0, 123456789);
+
+    WiegandFrame frame;
+    WiegandCard card;
+    for (auto _ : state)
+    {
+        frame.clear();
+        for (int i = length - 1; i >= 0; i--)
+        {
+            frame.push((bits >> i) & 1);
+        }
+        bool ok = WiegandFormats::decode(frame, card);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(card);
+    }
+}
+BENCHMARK(BM_WiegandDecode)->Arg(26)->Arg(34)->Arg(37);
+
+// Lookup in the credential table; range(1) selects enrolled (1) or unknown (0) cards
+static void BM_CredentialLookup(benchmark::State& state)
+{
+    auto enrolled = makeCards(state.range(0), 1);
+    CredentialTable::Builder builder;
+    for (uint64_t card : enrolled)
+    {
+        builder.add(card, 1, "Bench User");
+    }
+    auto table = builder.build();
+    auto probes = state.range(1) ? enrolled : makeCards(4096, 2);
+
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        auto credential = table->find(probes[i++ % probes.size()]);
+        benchmark::DoNotOptimize(credential);
+    }
+}
+BENCHMARK(BM_CredentialLookup)->ArgsProduct({{1000, 100000, 1000000}, {0, 1}});
+
+// Baseline: the original whitelist, keyed by the card's hex string
+static void BM_HexWhitelistLookup(benchmark::State& state)
+{
+    auto enrolled = makeCards(state.range(0), 1);
+    std::unordered_map<std::string, AccessMask> whitelist;
+    for (uint64_t card : enrolled)
+    {
+        WiegandHexString hexBuf;
+        whitelist.emplace(std::string(formatWiegandHex(card, 34, hexBuf)), 1);
+    }
+    auto probes = state.range(1) ? enrolled : makeCards(4096, 2);
+
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        WiegandHexString hexBuf;
+        std::string hex(formatWiegandHex(probes[i++ % probes.size()], 34, hexBuf));
+        bool found = whitelist.count(hex) > 0;
+        benchmark::DoNotOptimize(found);
+    }
+}
+BENCHMARK(BM_HexWhitelistLookup)->ArgsProduct({{1000, 100000, 1000000}, {0, 1}});
+
+// Payload formats by benchmark argument, labelled with the payload size
+static PayloadFormat benchFormat(benchmark::State& state)
+{
+    static const char* const kNames[] = {"json", "cbor", "msgpack"};
+    state.SetLabel(kNames[state.range(0)]);
+    return static_cast<PayloadFormat>(state.range(0));
+}
+
+// Snapshot and serialize a door's status, written the way Door does for
+// every status publish
+static void BM_DoorStatePayload(benchmark::State& state)
+{
+    PayloadFormat format = benchFormat(state);
+    DoorState doorState;
+    doorState.recordCard("0x2b3a4c5d6", std::chrono::system_clock::now());
+    doorState.set(DoorState::DoorOpen, true);
+
+    std::string buffer;
+    for (auto _ : state)
+    {
+        DoorState::Snapshot status = doorState.snapshot();
+        std::string_view payload = PayloadWriter(buffer, format)
+            .field("locked", status.isLocked())
+            .field("open", status.isDoorOpen())
+            .field("proximityDetected", status.isProximityDetected())
+            .field("exitButtonPressed", status.isExitButtonPressed())
+            .field("lastCard", std::string_view(status.lastCard))
+            .field("lastEventTime", status.lastEventTime)
+            .finish();
+        benchmark::DoNotOptimize(payload.data());
+    }
+    state.counters["bytes"] = static_cast<double>(buffer.size());
+}
+BENCHMARK(BM_DoorStatePayload)->DenseRange(0, 2);
+
+// The access event payload, written the way Door does
+static void BM_AccessPayload(benchmark::State& state)
+{
+    PayloadFormat format = benchFormat(state);
+    CardReadEvent event = makeReadEvent(Wiegand34::encode(4242, 12345));
+    std::string doorId = "Cubicle Door";
+    std::string buffer;
+    for (auto _ : state)
+    {
+        WiegandHexString hexBuf;
+        std::string_view payload = PayloadWriter(buffer, format)
+            .field("event", "access_attempt")
+            .field("door_id", doorId)
+            .beginObject("card")
+                .field("raw", formatWiegandHex(event.value, event.bitLength, hexBuf))
+                .field("format", event.format)
+                .field("facility_code", event.facilityCode)
+                .field("number", event.cardNumber)
+            .endObject()
+            .beginObject("access")
+                .field("granted", true)
+                .field("parity_valid", event.parityValid)
+            .endObject()
+            .field("timestamp", static_cast<int64_t>(std::chrono::system_clock::to_time_t(event.timestamp)))
+            .finish();
+        benchmark::DoNotOptimize(payload.data());
+    }
+    state.counters["bytes"] = static_cast<double>(buffer.size());
+}
+BENCHMARK(BM_AccessPayload)->DenseRange(0, 2);
+
+// Baseline: the same payload built as a JSON document and dumped
+static void BM_AccessPayloadNlohmann(benchmark::State& state)
+{
+    CardReadEvent event = makeReadEvent(Wiegand34::encode(4242, 12345));
+    std::string doorId = "Cubicle Door";
+    for (auto _ : state)
+    {
+        WiegandHexString hexBuf;
+        nlohmann::json message;
+        message["event"] = "access_attempt";
+        message["door_id"] = doorId;
+        message["card"]["raw"] = std::string(formatWiegandHex(event.value, event.bitLength, hexBuf));
+        message["card"]["format"] = event.format;
+        message["card"]["facility_code"] = event.facilityCode;
+        message["card"]["number"] = event.cardNumber;
+        message["access"]["granted"] = true;
+        message["access"]["parity_valid"] = event.parityValid;
+        message["timestamp"] = std::chrono::system_clock::to_time_t(event.timestamp);
+        std::string json = message.dump();
+        benchmark::DoNotOptimize(json.data());
+    }
+}
+BENCHMARK(BM_AccessPayloadNlohmann);
+
+// Everything a door does with a decoded card: access check, audit record,
+// log line, unlock and the queued access publish. range(0) selects an
+// enrolled (1) or unknown (0) card. A granted door is already unlocked after
+// the first iteration, so later grants only push the relock deadline back.
+static void BM_HandleCardRead(benchmark::State& state)
+{
+    auto enrolled = makeCards(100000, 1);
+    Site site(1, enrolled, std::chrono::milliseconds(5000), true);
+    auto probes = state.range(0) ? enrolled : makeCards(4096, 2);
+
+    std::vector<CardReadEvent> events;
+    for (size_t i = 0; i < 4096; i++)
+    {
+        events.push_back(makeReadEvent(probes[i % probes.size()]));
+    }
+
+    Door& door = *site.doors[0];
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        door.onCardRead(events[i++ % events.size()]);
+    }
+}
+BENCHMARK(BM_HandleCardRead)->Arg(0)->Arg(1);
+
+// A cross-door decision: one door's grant goes out on the event bus and the
+// anti-passback check at the area's other door catches up on it. Cards
+// alternate between the entry and the exit, so every check is allowed.
+static void BM_AntiPassbackCheck(benchmark::State& state)
+{
+    auto loop = std::make_shared<EventLoop>();
+    auto events = std::make_shared<DoorEventBus>();
+    AntiPassback antiPassback(events, loop);
+    uint16_t entry = events->registerDoor("bench-entry");
+    uint16_t exit = events->registerDoor("bench-exit");
+    antiPassback.addDoor(entry, {"bench-area", true});
+    antiPassback.addDoor(exit, {"bench-area", false});
+
+    auto cards = makeCards(4096, 3);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        uint64_t card = cards[i % cards.size()];
+        bool in = (i / cards.size()) % 2 == 0;
+        events->publish(DoorEvent::Kind::AccessGranted, in ? entry : exit, card);
+        benchmark::DoNotOptimize(antiPassback.allows(in ? exit : entry, card));
+        i++;
+    }
+}
+BENCHMARK(BM_AntiPassbackCheck);
+
+// Whole pipeline: every door gets a card at the same moment, clocked in edge
+// by edge on the simulated backend, and the iteration ends once every unlock
+// relay has been driven. Latency runs from a card's last edge to its relay
+// and includes the 50 ms inter-frame gap the decoder waits for. Events per
+// second counts cards over the time from the first moment a frame could be
+// decoded, one gap after it ended, to the last relay.
+static void BM_EdgeToRelay(benchmark::State& state)
+{
+    unsigned int doorCount = static_cast<unsigned int>(state.range(0));
+    std::vector<uint64_t> cards;
+    for (unsigned int i = 0; i < doorCount; i++)
+    {
+        cards.push_back(Wiegand26::encode(42, i));
+    }
+    Site site(doorCount, cards, std::chrono::milliseconds(10));
+
+    std::vector<Clock::time_point> frameEnds(doorCount);
+    std::vector<double> latencies;
+    unsigned int relays = 0;
+    unsigned int locks = 0;
+    Clock::time_point lastRelay;
+    site.onRelay = [&](unsigned int door, int value)
+    {
+        if (value == 1)
+        {
+            auto now = Clock::now();
+            latencies.push_back(std::chrono::duration<double, std::milli>(now - frameEnds[door]).count());
+            lastRelay = now;
+            relays++;
+        }
+    };
+    site.onLock = [&](unsigned int) { locks++; };
+
+    double busySeconds = 0;
+    for (auto _ : state)
+    {
+        relays = 0;
+        auto start = Clock::now();
+        Clock::time_point firstFrameEnd = Clock::time_point::max();
+        for (unsigned int i = 0; i < doorCount; i++)
+        {
+            frameEnds[i] = site.backend->injectWiegand(GpioChipRegistry::kDefaultChip,
+                i * kPinsPerDoor, i * kPinsPerDoor + 1, cards[i], 26, start);
+            firstFrameEnd = std::min(firstFrameEnd, frameEnds[i]);
+        }
+
+        auto deadline = start + std::chrono::seconds(10);
+        while (relays < doorCount && Clock::now() < deadline)
+        {
+            site.loop->runOnce(10);
+        }
+        if (relays < doorCount)
+        {
+            state.SkipWithError("Not every relay was driven");
+            break;
+        }
+        state.SetIterationTime(std::chrono::duration<double>(lastRelay - start).count());
+        busySeconds += std::chrono::duration<double>(lastRelay - firstFrameEnd - kFrameGap).count();
+
+        // Wait for every door to lock again before the next round
+        locks = 0;
+        while (locks < doorCount && Clock::now() < deadline)
+        {
+            site.loop->runOnce(10);
+        }
+    }
+
+    state.counters["p50_ms"] = percentile(latencies, 0.5);
+    state.counters["p99_ms"] = percentile(latencies, 0.99);
+    state.counters["p999_ms"] = percentile(latencies, 0.999);
+    state.counters["events_per_s"] = busySeconds > 0 ? latencies.size() / busySeconds : 0;
+}
+BENCHMARK(BM_EdgeToRelay)
+    ->Arg(1)->Arg(10)->Arg(100)->Arg(500)
+    ->Iterations(20)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv)
+{
+    // Door loggers have no sinks here: log calls still format and queue,
+    // but nothing is written
+    LogOptions logOptions;
+    logOptions.console = false;
+    logOptions.directory.clear();
+    Logger::initializeGlobal(logOptions);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    Logger::shutdown();
+    return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+enum class AccessLevel
+{
+    REGULAR,
+    ITAR,
+    ITAR_SERVER_ROOM
+};
+
+// Set of access levels, one bit per AccessLevel
+using AccessMask = uint32_t;
+
+constexpr AccessMask accessBit(AccessLevel level)
+{
+    return AccessMask{1} << static_cast<unsigned>(level);
+}
+
+// Cards with any of levels may use a door while the named schedule is open
+struct AccessRule
+{
+    AccessMask levels;
+    std::string schedule;
+};
+
+const std::unordered_map<AccessLevel, std::string> ACCESS_LEVEL_NAMES =
+{
+    {AccessLevel::REGULAR, "Regular"},
+    {AccessLevel::ITAR, "ITAR"},
+    {AccessLevel::ITAR_SERVER_ROOM, "ITAR Server Room"}
+};
+
+inline bool parseAccessLevel(const std::string& name, AccessLevel& level)
+{
+    for (const auto& [value, levelName] : ACCESS_LEVEL_NAMES)
+    {
+        if (levelName == name)
+        {
+            level = value;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,371 @@
+#pragma once
+#include <time.h>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "access_level.hpp"
+
+// Schedules are kept as one bit per 15 minutes of the week, Monday 00:00
+// local time first
+constexpr unsigned kScheduleSlotMinutes = 15;
+constexpr unsigned kScheduleSlotsPerDay = 24 * 60 / kScheduleSlotMinutes;
+constexpr unsigned kScheduleSlotsPerWeek = 7 * kScheduleSlotsPerDay;
+
+// A recurring weekly time window. to <= from wraps past midnight into the
+// next day.
+struct ScheduleWindow
+{
+    uint8_t days;        // Bit 0 is Monday
+    uint16_t fromSlot;   // Slot of the day, 0 to kScheduleSlotsPerDay
+    uint16_t toSlot;
+};
+
+// When a schedule is open, in local time. Holidays close it for the whole
+// day and are local dates as days since 1970-01-01.
+struct WeeklySchedule
+{
+    std::vector<ScheduleWindow> windows;
+    std::set<int64_t> holidays;
+};
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+constexpr int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+// {"weekly": [{"days": ["mon", "fri"], "from": "08:00", "to": "18:00"}],
+//  "holidays": ["2026-12-25"]}
+// Times must fall on a 15 minute boundary; "24:00" is the end of the day.
+// Throws std::invalid_argument naming the offending field.
+inline WeeklySchedule parseWeeklySchedule(const nlohmann::json& json)
+{
+    static const char* const kDayNames[] = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+    auto parseTime = [](const nlohmann::json& value, const char* field)
+    {
+        unsigned hours = 0;
+        unsigned minutes = 0;
+        char extra;
+        if (!value.is_string() ||
+            std::sscanf(value.get<std::string>().c_str(), "%2u:%2u%c", &hours, &minutes, &extra) != 2 ||
+            minutes >= 60 || hours * 60 + minutes > 24 * 60 || minutes % kScheduleSlotMinutes != 0)
+        {
+            throw std::invalid_argument(std::string(field) + ": expected HH:MM on a 15 minute boundary");
+        }
+        return static_cast<uint16_t>((hours * 60 + minutes) / kScheduleSlotMinutes);
+    };
+
+    if (!json.is_object())
+    {
+        throw std::invalid_argument("expected an object");
+    }
+    for (const auto& item : json.items())
+    {
+        if (item.key() != "weekly" && item.key() != "holidays")
+        {
+            throw std::invalid_argument(item.key() + ": unknown key");
+        }
+    }
+
+    WeeklySchedule schedule;
+    const auto weekly = json.find("weekly");
+    if (weekly == json.end() || !weekly->is_array())
+    {
+        throw std::invalid_argument("weekly: expected an array");
+    }
+    for (const auto& window : *weekly)
+    {
+        if (!window.is_object() || !window.contains("days") || !window["days"].is_array())
+        {
+            throw std::invalid_argument("weekly: expected {\"days\": [...], \"from\": ..., \"to\": ...}");
+        }
+        ScheduleWindow parsed{0, parseTime(window.value("from", nlohmann::json()), "from"),
+            parseTime(window.value("to", nlohmann::json()), "to")};
+        for (const auto& day : window["days"])
+        {
+            unsigned index = 0;
+            while (index < 7 && !(day.is_string() && day == kDayNames[index]))
+            {
+                index++;
+            }
+            if (index == 7)
+            {
+                throw std::invalid_argument("days: expected mon, tue, wed, thu, fri, sat or sun");
+            }
+            parsed.days |= 1 << index;
+        }
+        schedule.windows.push_back(parsed);
+    }
+
+    for (const auto& holiday : json.value("holidays", nlohmann::json::array()))
+    {
+        unsigned year = 0;
+        unsigned month = 0;
+        unsigned day = 0;
+        char extra;
+        if (!holiday.is_string() ||
+            std::sscanf(holiday.get<std::string>().c_str(), "%4u-%2u-%2u%c", &year, &month, &day, &extra) != 3 ||
+            month < 1 || month > 12 || day < 1 || day > 31)
+        {
+            throw std::invalid_argument("holidays: expected YYYY-MM-DD dates");
+        }
+        schedule.holidays.insert(daysFromCivil(year, month, day));
+    }
+    return schedule;
+}
+
+// Decides whether a card's access levels open a door at a given time, in
+// constant time.
+//
+// Every door has a row with one access mask per 15 minute slot of the
+// current week: the levels its rules let in during that slot. A decision
+// is one AND of the card's levels with the mask for now. Rows are compiled
+// from each schedule's slot bitmap for the week, with the week's holidays
+// applied.
+//
+// The compiled plan is immutable and swapped in with a single atomic store,
+// as CredentialStore does with its table. Changing a schedule recompiles
+// that bitmap and only the rows of doors that use it; every other row is
+// shared with the previous plan. The first decision in a new week compiles
+// that week.
+class AccessPolicy
+{
+public:
+    using DoorHandle = size_t;
+
+    enum class Decision
+    {
+        Granted,
+        LevelNotAllowed,   // None of the card's levels may use this door
+        OutsideSchedule    // A level may, but not at this time
+    };
+
+    // Open around the clock, holidays included
+    static constexpr const char* kAlways = "always";
+
+    AccessPolicy()
+        : plan_(std::make_shared<Plan>())
+    {
+    }
+
+    // Add or replace a schedule
+    void setSchedule(const std::string& name, WeeklySchedule schedule)
+    {
+        if (name == kAlways)
+        {
+            throw std::invalid_argument("The always schedule is built in");
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        schedules_[name] = std::move(schedule);
+
+        auto current = std::atomic_load(&plan_);
+        if (current->weekStart == kNoWeek)
+        {
+            return;  // Compiled with the first week
+        }
+        auto plan = std::make_shared<Plan>(*current);
+        plan->bitmaps[name] = compileSchedule(name, plan->weekStart);
+        for (size_t door = 0; door < doorRules_.size(); door++)
+        {
+            if (usesSchedule(doorRules_[door], name))
+            {
+                plan->doors[door] = compileDoor(doorRules_[door], *plan);
+            }
+        }
+        std::atomic_store(&plan_, std::shared_ptr<const Plan>(plan));
+    }
+
+    // No rules lets every level in at any time
+    DoorHandle addDoor(std::vector<AccessRule> rules)
+    {
+        if (rules.empty())
+        {
+            rules.push_back({~AccessMask{0}, kAlways});
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        doorRules_.push_back(std::move(rules));
+        auto plan = std::make_shared<Plan>(*std::atomic_load(&plan_));
+        plan->doors.push_back(plan->weekStart == kNoWeek ? nullptr : compileDoor(doorRules_.back(), *plan));
+        std::atomic_store(&plan_, std::shared_ptr<const Plan>(plan));
+        return doorRules_.size() - 1;
+    }
+
+    Decision check(DoorHandle door, AccessMask card,
+        std::chrono::system_clock::time_point when = std::chrono::system_clock::now())
+    {
+        auto [weekStart, slot] = localSlot(when);
+        auto plan = std::atomic_load(&plan_);
+        if (plan->weekStart != weekStart)
+        {
+            compileWeek(weekStart);
+            plan = std::atomic_load(&plan_);
+        }
+
+        const DoorRow& row = *plan->doors.at(door);
+        if (row.slots[slot] & card)
+        {
+            return Decision::Granted;
+        }
+        return row.levels & card ? Decision::OutsideSchedule : Decision::LevelNotAllowed;
+    }
+
+private:
+    using SlotBitmap = std::bitset<kScheduleSlotsPerWeek>;
+
+    struct DoorRow
+    {
+        AccessMask levels{0};  // Every level any rule names
+        std::array<AccessMask, kScheduleSlotsPerWeek> slots{};
+    };
+
+    struct Plan
+    {
+        int64_t weekStart{kNoWeek};  // Local date of the week's Monday
+        std::map<std::string, std::shared_ptr<const SlotBitmap>> bitmaps;
+        std::vector<std::shared_ptr<const DoorRow>> doors;
+    };
+
+    static constexpr int64_t kNoWeek = INT64_MIN;
+
+    // Monday of the local week containing when, and the slot within it
+    static std::pair<int64_t, unsigned> localSlot(std::chrono::system_clock::time_point when)
+    {
+        time_t seconds = std::chrono::system_clock::to_time_t(when);
+        tm local;
+        localtime_r(&seconds, &local);
+        int64_t today = daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+        unsigned weekday = (local.tm_wday + 6) % 7;
+        unsigned slot = weekday * kScheduleSlotsPerDay +
+            (local.tm_hour * 60 + local.tm_min) / kScheduleSlotMinutes;
+        return {today - weekday, slot};
+    }
+
+    static bool usesSchedule(const std::vector<AccessRule>& rules, const std::string& name)
+    {
+        for (const auto& rule : rules)
+        {
+            if (rule.schedule == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Unknown schedules are never open
+    std::shared_ptr<const SlotBitmap> compileSchedule(const std::string& name, int64_t weekStart) const
+    {
+        auto bitmap = std::make_shared<SlotBitmap>();
+        if (name == kAlways)
+        {
+            bitmap->set();
+            return bitmap;
+        }
+        auto it = schedules_.find(name);
+        if (it == schedules_.end())
+        {
+            return bitmap;
+        }
+
+        const WeeklySchedule& schedule = it->second;
+        for (const auto& window : schedule.windows)
+        {
+            for (unsigned day = 0; day < 7; day++)
+            {
+                if (!(window.days & (1 << day)))
+                {
+                    continue;
+                }
+                unsigned from = day * kScheduleSlotsPerDay + window.fromSlot;
+                unsigned to = day * kScheduleSlotsPerDay + window.toSlot +
+                    (window.toSlot <= window.fromSlot ? kScheduleSlotsPerDay : 0);
+                for (unsigned slot = from; slot < to; slot++)
+                {
+                    bitmap->set(slot % kScheduleSlotsPerWeek);
+                }
+            }
+        }
+
+        for (unsigned day = 0; day < 7; day++)
+        {
+            if (schedule.holidays.count(weekStart + day))
+            {
+                for (unsigned slot = 0; slot < kScheduleSlotsPerDay; slot++)
+                {
+                    bitmap->reset(day * kScheduleSlotsPerDay + slot);
+                }
+            }
+        }
+        return bitmap;
+    }
+
+    static std::shared_ptr<const DoorRow> compileDoor(const std::vector<AccessRule>& rules, const Plan& plan)
+    {
+        auto row = std::make_shared<DoorRow>();
+        for (const auto& rule : rules)
+        {
+            row->levels |= rule.levels;
+            auto bitmap = plan.bitmaps.find(rule.schedule);
+            if (bitmap == plan.bitmaps.end())
+            {
+                continue;
+            }
+            for (unsigned slot = 0; slot < kScheduleSlotsPerWeek; slot++)
+            {
+                if (bitmap->second->test(slot))
+                {
+                    row->slots[slot] |= rule.levels;
+                }
+            }
+        }
+        return row;
+    }
+
+    void compileWeek(int64_t weekStart)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (std::atomic_load(&plan_)->weekStart == weekStart)
+        {
+            return;  // Another thread got here first
+        }
+
+        auto plan = std::make_shared<Plan>();
+        plan->weekStart = weekStart;
+        plan->bitmaps[kAlways] = compileSchedule(kAlways, weekStart);
+        for (const auto& entry : schedules_)
+        {
+            plan->bitmaps[entry.first] = compileSchedule(entry.first, weekStart);
+        }
+        for (const auto& rules : doorRules_)
+        {
+            plan->doors.push_back(compileDoor(rules, *plan));
+        }
+        std::atomic_store(&plan_, std::shared_ptr<const Plan>(plan));
+    }
+
+    // Definitions; only touched under mutex_
+    std::mutex mutex_;
+    std::map<std::string, WeeklySchedule> schedules_;
+    std::vector<std::vector<AccessRule>> doorRules_;
+
+    std::shared_ptr<const Plan> plan_;
+};
@@ -0,0 +1,588 @@
+#pragma once
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "../core/event_loop.hpp"
+
+enum class AuditDecision : uint8_t
+{
+    Denied = 0,
+    Granted = 1
+};
+
+// Why a door was or wasn't opened. Values are part of the on-disk format.
+enum class AuditReason : uint8_t
+{
+    CardAccepted = 0,
+    UnknownCard = 1,
+    ExitButton = 2,
+    Proximity = 3,
+    RemoteCommand = 4,
+    LevelNotAllowed = 5,
+    OutsideSchedule = 6,
+    AntiPassback = 7,
+    ParityError = 8
+};
+
+inline const char* auditReasonName(AuditReason reason)
+{
+    switch (reason)
+    {
+        case AuditReason::CardAccepted: return "card_accepted";
+        case AuditReason::UnknownCard: return "unknown_card";
+        case AuditReason::ExitButton: return "exit_button";
+        case AuditReason::Proximity: return "proximity";
+        case AuditReason::RemoteCommand: return "remote_command";
+        case AuditReason::LevelNotAllowed: return "level_not_allowed";
+        case AuditReason::OutsideSchedule: return "outside_schedule";
+        case AuditReason::AntiPassback: return "anti_passback";
+        case AuditReason::ParityError: return "parity_error";
+    }
+    return "unknown";
+}
+
+struct AuditRecord
+{
+    uint64_t sequence;      // Starts at 1; 0 marks a slot never written
+    int64_t timestampMs;    // system_clock, milliseconds since the epoch
+    uint64_t card;          // 0 for events without a card
+    uint16_t doorIndex;     // See AuditJournal::doorName()
+    uint8_t bitLength;
+    AuditDecision decision;
+    AuditReason reason;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(AuditRecord) == 32, "AuditRecord layout is part of the on-disk format");
+
+struct AuditQuery
+{
+    std::optional<uint64_t> card;
+    std::optional<uint16_t> doorIndex;
+    int64_t fromMs{std::numeric_limits<int64_t>::min()};
+    int64_t toMs{std::numeric_limits<int64_t>::max()};
+    size_t limit{100};
+};
+
+// Append-only journal of access decisions. Fixed-size records go into
+// preallocated, memory-mapped segment files, so an append is a memcpy into
+// the page cache and nothing is parsed to read them back. Each full segment
+// gets a companion index sorted by card and time, which answers "who used
+// card X between A and B" with a binary search per segment. The active
+// segment is indexed in memory, and each segment's time range lets queries
+// skip segments entirely.
+//
+// Records reach disk according to the sync policy. After a crash, only
+// records whose sequence number matches their slot are kept, so a torn tail
+// is dropped on the next start.
+//
+// Not thread-safe: use from the event loop thread.
+class AuditJournal
+{
+public:
+    enum class SyncPolicy
+    {
+        EveryRecord,  // msync after each append
+        Interval,     // msync on a timer (see attach())
+        OsManaged     // Leave write-back to the kernel
+    };
+
+    struct Options
+    {
+        std::string directory{"journal"};
+        uint32_t segmentRecords{65536};  // 2MB segments
+        size_t maxSegments{0};           // Oldest segments are deleted beyond this; 0 keeps all
+        SyncPolicy sync{SyncPolicy::Interval};
+        std::chrono::milliseconds syncInterval{1000};
+    };
+
+    explicit AuditJournal(const Options& options)
+        : options_(options)
+    {
+        if (options_.segmentRecords == 0)
+        {
+            throw std::runtime_error("Audit segments must hold at least one record");
+        }
+        std::filesystem::create_directories(options_.directory);
+        loadDoorNames();
+        openSegments();
+    }
+
+    ~AuditJournal()
+    {
+        syncTimer_.reset();
+        sync();
+        for (auto& segment : segments_)
+        {
+            unmap(segment);
+        }
+    }
+
+    AuditJournal(const AuditJournal&) = delete;
+    AuditJournal& operator=(const AuditJournal&) = delete;
+
+    // Sync on a timer for SyncPolicy::Interval
+    void attach(std::shared_ptr<EventLoop> loop)
+    {
+        loop_ = loop;
+        if (options_.sync == SyncPolicy::Interval)
+        {
+            syncTimer_ = std::make_unique<TimerWheel::Timer>(loop_->timers(), [this]()
+            {
+                sync();
+                syncTimer_->start(options_.syncInterval);
+            });
+            syncTimer_->start(options_.syncInterval);
+        }
+    }
+
+    // Stable small number for a door name, kept across restarts
+    uint16_t registerDoor(const std::string& doorId)
+    {
+        for (size_t i = 0; i < doorNames_.size(); i++)
+        {
+            if (doorNames_[i] == doorId)
+            {
+                return static_cast<uint16_t>(i);
+            }
+        }
+        if (doorNames_.size() > std::numeric_limits<uint16_t>::max())
+        {
+            throw std::runtime_error("Too many doors in audit journal");
+        }
+        std::ofstream file(doorNamesPath(), std::ios::app);
+        file << doorId << '\n';
+        doorNames_.push_back(doorId);
+        return static_cast<uint16_t>(doorNames_.size() - 1);
+    }
+
+    std::optional<uint16_t> findDoor(const std::string& doorId) const
+    {
+        for (size_t i = 0; i < doorNames_.size(); i++)
+        {
+            if (doorNames_[i] == doorId)
+            {
+                return static_cast<uint16_t>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string doorName(uint16_t index) const
+    {
+        return index < doorNames_.size() ? doorNames_[index] : std::to_string(index);
+    }
+
+    // Returns the record's sequence number
+    uint64_t append(uint16_t doorIndex, uint64_t card, uint8_t bitLength,
+        AuditDecision decision, AuditReason reason,
+        std::chrono::system_clock::time_point when = std::chrono::system_clock::now())
+    {
+        Segment* segment = &segments_.back();
+        if (segment->count == segment->capacity)
+        {
+            seal(*segment);
+            createSegment(nextSequence_);
+            enforceRetention();
+            segment = &segments_.back();
+        }
+
+        AuditRecord record{};
+        record.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            when.time_since_epoch()).count();
+        record.card = card;
+        record.doorIndex = doorIndex;
+        record.bitLength = bitLength;
+        record.decision = decision;
+        record.reason = reason;
+
+        // The sequence goes in last; it is what marks the slot as written
+        uint32_t slot = segment->count;
+        AuditRecord& target = segment->records[slot];
+        target = record;
+        std::atomic_thread_fence(std::memory_order_release);
+        target.sequence = nextSequence_;
+
+        segment->count++;
+        segment->minTime = std::min(segment->minTime, record.timestampMs);
+        segment->maxTime = std::max(segment->maxTime, record.timestampMs);
+        activeIndex_[card].push_back(slot);
+        dirty_ = true;
+
+        if (options_.sync == SyncPolicy::EveryRecord)
+        {
+            sync();
+        }
+        return nextSequence_++;
+    }
+
+    // Newest records first
+    std::vector<AuditRecord> query(const AuditQuery& query) const
+    {
+        std::vector<AuditRecord> results;
+        for (auto it = segments_.rbegin(); it != segments_.rend() && results.size() < query.limit; ++it)
+        {
+            const Segment& segment = *it;
+            if (segment.count == 0 || segment.maxTime < query.fromMs || segment.minTime > query.toMs)
+            {
+                continue;
+            }
+
+            auto consider = [&](uint32_t slot)
+            {
+                const AuditRecord& record = segment.records[slot];
+                if (record.timestampMs < query.fromMs || record.timestampMs > query.toMs ||
+                    (query.card && record.card != *query.card) ||
+                    (query.doorIndex && record.doorIndex != *query.doorIndex))
+                {
+                    return;
+                }
+                results.push_back(record);
+            };
+
+            if (!query.card)
+            {
+                for (uint32_t slot = segment.count; slot-- > 0 && results.size() < query.limit;)
+                {
+                    consider(slot);
+                }
+            }
+            else if (&segment == &segments_.back())
+            {
+                auto found = activeIndex_.find(*query.card);
+                if (found != activeIndex_.end())
+                {
+                    const auto& slots = found->second;
+                    for (auto slot = slots.rbegin(); slot != slots.rend() && results.size() < query.limit; ++slot)
+                    {
+                        consider(*slot);
+                    }
+                }
+            }
+            else
+            {
+                const auto& index = segment.cardIndex;
+                auto first = std::lower_bound(index.begin(), index.end(),
+                    IndexEntry{*query.card, query.fromMs, 0, 0});
+                auto last = std::upper_bound(index.begin(), index.end(),
+                    IndexEntry{*query.card, query.toMs, UINT32_MAX, 0});
+                while (last != first && results.size() < query.limit)
+                {
+                    consider((--last)->slot);
+                }
+            }
+        }
+
+        // Segments are searched newest first, but within a segment the card
+        // index is ordered by timestamp rather than append order
+        std::stable_sort(results.begin(), results.end(), [](const AuditRecord& a, const AuditRecord& b)
+        {
+            return a.sequence > b.sequence;
+        });
+        return results;
+    }
+
+    // Flush appended records to disk
+    void sync()
+    {
+        if (!dirty_ || segments_.empty())
+        {
+            return;
+        }
+        Segment& segment = segments_.back();
+        if (msync(segment.mapping, segment.size, MS_SYNC) != 0)
+        {
+            spdlog::error("Failed to sync audit journal {}", segment.path);
+            return;
+        }
+        dirty_ = false;
+    }
+
+    uint64_t nextSequence() const { return nextSequence_; }
+
+private:
+    struct SegmentHeader
+    {
+        static constexpr char kMagic[8] = {'D', 'O', 'O', 'R', 'A', 'U', 'D', 'T'};
+        static constexpr uint32_t kVersion = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity;
+        uint64_t firstSequence;
+        uint8_t reserved[40];
+    };
+    static_assert(sizeof(SegmentHeader) == 64, "Segment header layout is part of the on-disk format");
+
+    // Sorted by card, then time; written next to each sealed segment
+    struct IndexEntry
+    {
+        uint64_t card;
+        int64_t timestampMs;
+        uint32_t slot;
+        uint32_t reserved;
+
+        bool operator<(const IndexEntry& other) const
+        {
+            if (card != other.card) return card < other.card;
+            if (timestampMs != other.timestampMs) return timestampMs < other.timestampMs;
+            return slot < other.slot;
+        }
+    };
+    static_assert(sizeof(IndexEntry) == 24, "Index layout is part of the on-disk format");
+
+    struct Segment
+    {
+        std::string path;
+        uint64_t firstSequence{0};
+        uint32_t capacity{0};
+        uint32_t count{0};
+        int64_t minTime{std::numeric_limits<int64_t>::max()};
+        int64_t maxTime{std::numeric_limits<int64_t>::min()};
+        void* mapping{nullptr};
+        size_t size{0};
+        AuditRecord* records{nullptr};
+        std::vector<IndexEntry> cardIndex;  // Sealed segments only
+    };
+
+    std::string doorNamesPath() const
+    {
+        return options_.directory + "/doors.txt";
+    }
+
+    std::string segmentPath(uint64_t firstSequence) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "audit-%016" PRIx64 ".seg", firstSequence);
+        return options_.directory + "/" + name;
+    }
+
+    static std::string indexPath(const std::string& segmentPath)
+    {
+        return segmentPath.substr(0, segmentPath.size() - 4) + ".idx";
+    }
+
+    void loadDoorNames()
+    {
+        std::ifstream file(doorNamesPath());
+        for (std::string line; std::getline(file, line);)
+        {
+            doorNames_.push_back(line);
+        }
+    }
+
+    void openSegments()
+    {
+        std::vector<std::string> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(options_.directory))
+        {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("audit-", 0) == 0 && entry.path().extension() == ".seg")
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());  // Names sort by first sequence
+
+        for (const auto& path : paths)
+        {
+            if (!segments_.empty())
+            {
+                seal(segments_.back());
+            }
+            segments_.push_back(mapSegment(path));
+        }
+
+        if (segments_.empty())
+        {
+            createSegment(1);
+            return;
+        }
+
+        Segment& active = segments_.back();
+        nextSequence_ = active.firstSequence + active.count;
+        for (uint32_t slot = 0; slot < active.count; slot++)
+        {
+            activeIndex_[active.records[slot].card].push_back(slot);
+        }
+        spdlog::info("Audit journal opened with {} segments, next sequence {}", segments_.size(), nextSequence_);
+    }
+
+    Segment mapSegment(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open audit segment " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader))
+        {
+            close(fd);
+            throw std::runtime_error(path + " is too small to be an audit segment");
+        }
+
+        Segment segment;
+        segment.path = path;
+        segment.size = st.st_size;
+        segment.mapping = mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment.mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Cannot mmap audit segment " + path);
+        }
+
+        const auto* header = static_cast<const SegmentHeader*>(segment.mapping);
+        bool valid = std::memcmp(header->magic, SegmentHeader::kMagic, sizeof(header->magic)) == 0 &&
+            header->version == SegmentHeader::kVersion &&
+            sizeof(SegmentHeader) + uint64_t{header->capacity} * sizeof(AuditRecord) <= segment.size;
+        if (!valid)
+        {
+            munmap(segment.mapping, segment.size);
+            throw std::runtime_error(path + " is not a valid audit segment");
+        }
+
+        segment.firstSequence = header->firstSequence;
+        segment.capacity = header->capacity;
+        segment.records = reinterpret_cast<AuditRecord*>(static_cast<char*>(segment.mapping) + sizeof(SegmentHeader));
+
+        // Valid records form a prefix; anything after a gap is a torn write
+        while (segment.count < segment.capacity &&
+            segment.records[segment.count].sequence == segment.firstSequence + segment.count)
+        {
+            const AuditRecord& record = segment.records[segment.count];
+            segment.minTime = std::min(segment.minTime, record.timestampMs);
+            segment.maxTime = std::max(segment.maxTime, record.timestampMs);
+            segment.count++;
+        }
+        return segment;
+    }
+
+    Segment& createSegment(uint64_t firstSequence)
+    {
+        std::string path = segmentPath(firstSequence);
+        size_t size = sizeof(SegmentHeader) + size_t{options_.segmentRecords} * sizeof(AuditRecord);
+
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot create audit segment " + path);
+        }
+        // Reserve the blocks now so appends never hit ENOSPC through a page fault
+        if (posix_fallocate(fd, 0, size) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Cannot allocate audit segment " + path);
+        }
+
+        SegmentHeader header{};
+        std::memcpy(header.magic, SegmentHeader::kMagic, sizeof(header.magic));
+        header.version = SegmentHeader::kVersion;
+        header.capacity = options_.segmentRecords;
+        header.firstSequence = firstSequence;
+        bool written = pwrite(fd, &header, sizeof(header), 0) == sizeof(header) && fsync(fd) == 0;
+        close(fd);
+        if (!written)
+        {
+            throw std::runtime_error("Cannot write audit segment header " + path);
+        }
+
+        segments_.push_back(mapSegment(path));
+        activeIndex_.clear();
+        nextSequence_ = firstSequence;
+        return segments_.back();
+    }
+
+    // A segment stops taking appends: flush it and give it a card index,
+    // reusing the one on disk if it was already written
+    void seal(Segment& segment)
+    {
+        msync(segment.mapping, segment.size, MS_SYNC);
+        dirty_ = false;
+
+        std::string path = indexPath(segment.path);
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (in && static_cast<size_t>(in.tellg()) == segment.count * sizeof(IndexEntry))
+        {
+            segment.cardIndex.resize(segment.count);
+            in.seekg(0);
+            in.read(reinterpret_cast<char*>(segment.cardIndex.data()), segment.count * sizeof(IndexEntry));
+            if (in)
+            {
+                return;
+            }
+        }
+
+        segment.cardIndex.clear();
+        segment.cardIndex.reserve(segment.count);
+        for (uint32_t slot = 0; slot < segment.count; slot++)
+        {
+            const AuditRecord& record = segment.records[slot];
+            segment.cardIndex.push_back({record.card, record.timestampMs, slot, 0});
+        }
+        std::sort(segment.cardIndex.begin(), segment.cardIndex.end());
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(segment.cardIndex.data()),
+                segment.cardIndex.size() * sizeof(IndexEntry));
+            if (!out)
+            {
+                spdlog::error("Failed to write audit index {}", tmpPath);
+                return;
+            }
+        }
+        std::rename(tmpPath.c_str(), path.c_str());
+    }
+
+    void enforceRetention()
+    {
+        while (options_.maxSegments > 0 && segments_.size() > options_.maxSegments)
+        {
+            Segment& oldest = segments_.front();
+            spdlog::info("Removing audit segment {}", oldest.path);
+            unmap(oldest);
+            std::remove(oldest.path.c_str());
+            std::remove(indexPath(oldest.path).c_str());
+            segments_.erase(segments_.begin());
+        }
+    }
+
+    static void unmap(Segment& segment)
+    {
+        if (segment.mapping)
+        {
+            munmap(segment.mapping, segment.size);
+            segment.mapping = nullptr;
+            segment.records = nullptr;
+        }
+    }
+
+    Options options_;
+    std::vector<std::string> doorNames_;
+    std::vector<Segment> segments_;  // Oldest first; the last one takes appends
+    std::unordered_map<uint64_t, std::vector<uint32_t>> activeIndex_;
+    uint64_t nextSequence_{1};
+    bool dirty_{false};
+
+    std::shared_ptr<EventLoop> loop_;
+    std::unique_ptr<TimerWheel::Timer> syncTimer_;
+};
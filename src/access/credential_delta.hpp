@@ -0,0 +1,197 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "credential_table.hpp"
+
+// Credential updates from the central server. A delta takes the table from
+// baseVersion to version; a snapshot replaces it outright and is only sent
+// when a controller has missed a delta. Little-endian throughout:
+//
+//   header  magic "CRDU", u8 format (1), u8 kind (0 delta, 1 snapshot),
+//           u16 reserved, u64 baseVersion (0 for a snapshot), u64 version,
+//           u32 record count
+//   record  u8 op (1 add, 2 remove, 3 modify), u8 reserved, u16 name length,
+//           u32 access levels, u64 card, name bytes
+//
+// A snapshot holds only add records.
+struct CredentialUpdate
+{
+    enum class Kind : uint8_t
+    {
+        Delta = 0,
+        Snapshot = 1
+    };
+
+    Kind kind{Kind::Delta};
+    uint64_t baseVersion{0};
+    uint64_t version{0};
+    std::vector<CredentialChange> changes;  // Names point into the decoded payload
+};
+
+class CredentialUpdateCodec
+{
+public:
+    static std::string encode(const CredentialUpdate& update)
+    {
+        std::string out;
+        out.reserve(kHeaderSize + update.changes.size() * (kRecordSize + 16));
+        out.append(kMagic, 4);
+        put<uint8_t>(out, kFormat);
+        put<uint8_t>(out, static_cast<uint8_t>(update.kind));
+        put<uint16_t>(out, 0);
+        put<uint64_t>(out, update.baseVersion);
+        put<uint64_t>(out, update.version);
+        put<uint32_t>(out, static_cast<uint32_t>(update.changes.size()));
+        for (const auto& change : update.changes)
+        {
+            std::string_view userName = change.userName.substr(0, UINT16_MAX);
+            put<uint8_t>(out, static_cast<uint8_t>(change.op));
+            put<uint8_t>(out, 0);
+            put<uint16_t>(out, static_cast<uint16_t>(userName.size()));
+            put<uint32_t>(out, change.levels);
+            put<uint64_t>(out, change.card);
+            out.append(userName);
+        }
+        return out;
+    }
+
+    // Throws std::runtime_error on anything malformed; payload must outlive
+    // the result
+    static CredentialUpdate decode(std::string_view payload)
+    {
+        if (payload.size() < kHeaderSize || payload.compare(0, 4, kMagic) != 0)
+        {
+            throw std::runtime_error("not a credential update");
+        }
+        size_t pos = 4;
+        if (get<uint8_t>(payload, pos) != kFormat)
+        {
+            throw std::runtime_error("unsupported credential update format");
+        }
+
+        CredentialUpdate update;
+        uint8_t kind = get<uint8_t>(payload, pos);
+        if (kind > static_cast<uint8_t>(CredentialUpdate::Kind::Snapshot))
+        {
+            throw std::runtime_error("unknown credential update kind");
+        }
+        update.kind = static_cast<CredentialUpdate::Kind>(kind);
+        get<uint16_t>(payload, pos);
+        update.baseVersion = get<uint64_t>(payload, pos);
+        update.version = get<uint64_t>(payload, pos);
+        uint32_t count = get<uint32_t>(payload, pos);
+        if (update.version == 0 ||
+            (update.kind == CredentialUpdate::Kind::Delta && update.version <= update.baseVersion))
+        {
+            throw std::runtime_error("bad credential update version");
+        }
+        if (count > (payload.size() - pos) / kRecordSize)
+        {
+            throw std::runtime_error("truncated credential update");
+        }
+
+        update.changes.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (payload.size() - pos < kRecordSize)
+            {
+                throw std::runtime_error("truncated credential update");
+            }
+            CredentialChange change{};
+            uint8_t op = get<uint8_t>(payload, pos);
+            get<uint8_t>(payload, pos);
+            uint16_t nameLength = get<uint16_t>(payload, pos);
+            change.levels = get<uint32_t>(payload, pos);
+            change.card = get<uint64_t>(payload, pos);
+            if (op < static_cast<uint8_t>(CredentialChange::Op::Add) ||
+                op > static_cast<uint8_t>(CredentialChange::Op::Modify) ||
+                (update.kind == CredentialUpdate::Kind::Snapshot && op != static_cast<uint8_t>(CredentialChange::Op::Add)))
+            {
+                throw std::runtime_error("bad credential update record");
+            }
+            if (payload.size() - pos < nameLength)
+            {
+                throw std::runtime_error("truncated credential update");
+            }
+            change.op = static_cast<CredentialChange::Op>(op);
+            change.userName = payload.substr(pos, nameLength);
+            pos += nameLength;
+            update.changes.push_back(change);
+        }
+        if (pos != payload.size())
+        {
+            throw std::runtime_error("trailing bytes after credential update");
+        }
+        return update;
+    }
+
+    // Snapshot of everything in table
+    static CredentialUpdate snapshotOf(const CredentialTable& table, uint64_t version)
+    {
+        CredentialUpdate update;
+        update.kind = CredentialUpdate::Kind::Snapshot;
+        update.version = version;
+        update.changes.reserve(table.size());
+        table.forEach([&update](uint64_t card, const Credential& credential)
+        {
+            update.changes.push_back({CredentialChange::Op::Add, card, credential.levels, credential.userName});
+        });
+        return update;
+    }
+
+    // Changes that turn from into to
+    static std::vector<CredentialChange> diff(const CredentialTable& from, const CredentialTable& to)
+    {
+        std::vector<CredentialChange> changes;
+        from.forEach([&](uint64_t card, const Credential&)
+        {
+            if (!to.find(card))
+            {
+                changes.push_back({CredentialChange::Op::Remove, card, 0, {}});
+            }
+        });
+        to.forEach([&](uint64_t card, const Credential& credential)
+        {
+            auto old = from.find(card);
+            if (!old || old->userName != credential.userName)
+            {
+                changes.push_back({CredentialChange::Op::Add, card, credential.levels, credential.userName});
+            }
+            else if (old->levels != credential.levels)
+            {
+                changes.push_back({CredentialChange::Op::Modify, card, credential.levels, {}});
+            }
+        });
+        return changes;
+    }
+
+private:
+    template <typename T>
+    static void put(std::string& out, T value)
+    {
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+    }
+
+    template <typename T>
+    static T get(std::string_view in, size_t& pos)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(in[pos + i])) << (8 * i);
+        }
+        pos += sizeof(T);
+        return static_cast<T>(value);
+    }
+
+    static constexpr const char* kMagic = "CRDU";
+    static constexpr uint8_t kFormat = 1;
+    static constexpr size_t kHeaderSize = 28;
+    static constexpr size_t kRecordSize = 16;
+};
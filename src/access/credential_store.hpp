@@ -0,0 +1,244 @@
+#pragma once
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <spdlog/spdlog.h>
+#include "credential_table.hpp"
+#include "../core/background_thread.hpp"
+#include "../core/event_loop.hpp"
+
+// Owns the current credential table. Lookups take a snapshot of the table and
+// never wait for a reload: a new table is built off to the side and swapped in
+// with a single atomic store, and the old one is freed once the last reader
+// drops its snapshot.
+//
+// Loads either a compiled credential database (see credential_compiler),
+// which is mapped and used in place, or a JSON/CSV card list that is parsed
+// into memory.
+//
+// Tables from the central server carry a version (see CredentialSync). A
+// delta only applies to the version it was made against; a table loaded from
+// a file has version 0, which no delta applies to.
+class CredentialStore
+{
+public:
+    enum class DeltaResult
+    {
+        Applied,
+        Stale,  // Already have this version or a later one
+        Gap     // Made against a version we don't have
+    };
+
+    CredentialStore()
+        : table_(CredentialTable::Builder().build())
+    {
+    }
+
+    ~CredentialStore()
+    {
+        unwatch();
+
+        BackgroundThread reloadThread;
+        {
+            std::lock_guard<std::mutex> lock(reloadMutex_);
+            reloadPending_ = false;
+            reloadThread = std::move(reloadThread_);
+        }
+        if (reloadThread.joinable())
+        {
+            reloadThread.join();
+        }
+    }
+
+    std::shared_ptr<const CredentialTable> snapshot() const
+    {
+        return std::atomic_load(&table_);
+    }
+
+    void replace(std::shared_ptr<const CredentialTable> table, uint64_t version = 0)
+    {
+        std::lock_guard<std::mutex> lock(updateMutex_);
+        std::atomic_store(&table_, std::move(table));
+        version_ = version;
+    }
+
+    uint64_t version() const
+    {
+        return version_;
+    }
+
+    // Apply the changes that take baseVersion to version, copying the table
+    // rather than rebuilding it. Lookups keep using the old table until the
+    // new one is swapped in.
+    DeltaResult applyDelta(uint64_t baseVersion, uint64_t version, const std::vector<CredentialChange>& changes)
+    {
+        std::lock_guard<std::mutex> lock(updateMutex_);
+        if (version_ != 0 && version <= version_)
+        {
+            return DeltaResult::Stale;
+        }
+        if (version_ == 0 || baseVersion != version_)
+        {
+            return DeltaResult::Gap;
+        }
+        std::atomic_store(&table_, std::atomic_load(&table_)->withChanges(changes));
+        version_ = version;
+        return DeltaResult::Applied;
+    }
+
+    // Load path into a new table and swap it in. On failure the current
+    // table stays in place.
+    bool loadFromFile(const std::string& path)
+    {
+        try
+        {
+            std::shared_ptr<const CredentialTable> table;
+            if (CredentialTable::isDatabaseFile(path))
+            {
+                table = CredentialTable::mapFile(path);
+            }
+            else
+            {
+                std::ifstream file(path);
+                if (!file)
+                {
+                    spdlog::error("Cannot open credential file {}", path);
+                    return false;
+                }
+
+                CredentialTable::Builder builder;
+                if (std::filesystem::path(path).extension() == ".csv")
+                {
+                    readCredentialsCsv(file, builder);
+                }
+                else
+                {
+                    readCredentialsJson(file, builder);
+                }
+                table = builder.build();
+            }
+
+            size_t count = table->size();
+            replace(std::move(table));
+            spdlog::info("Loaded {} credentials from {}", count, path);
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Failed to load credentials from {}: {}", path, e.what());
+            return false;
+        }
+    }
+
+    // Reload path whenever it is rewritten or replaced. Watches the parent
+    // directory so editors that save through a rename are picked up too.
+    bool watch(const std::string& path, std::shared_ptr<EventLoop> loop)
+    {
+        std::filesystem::path file(path);
+        std::string dir = file.has_parent_path() ? file.parent_path().string() : ".";
+
+        inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd_ < 0 || inotify_add_watch(inotifyFd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            spdlog::error("Cannot watch {} for credential changes", dir);
+            unwatch();
+            return false;
+        }
+
+        path_ = path;
+        fileName_ = file.filename().string();
+        loop_ = loop;
+        return loop_->add(inotifyFd_, EPOLLIN, [this](uint32_t) { onFileEvent(); });
+    }
+
+    void unwatch()
+    {
+        if (inotifyFd_ >= 0)
+        {
+            if (loop_)
+            {
+                loop_->remove(inotifyFd_);
+            }
+            close(inotifyFd_);
+            inotifyFd_ = -1;
+        }
+    }
+
+private:
+    void onFileEvent()
+    {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t len;
+        while ((len = read(inotifyFd_, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + len;)
+            {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                if (event->len > 0 && fileName_ == event->name)
+                {
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        if (changed)
+        {
+            scheduleReload();
+        }
+    }
+
+    // Parse on a background thread so the event loop keeps decoding badges
+    // against the current table. Changes arriving mid-reload trigger one more pass.
+    void scheduleReload()
+    {
+        std::lock_guard<std::mutex> lock(reloadMutex_);
+        reloadPending_ = true;
+        if (reloading_)
+        {
+            return;
+        }
+
+        reloading_ = true;
+        if (reloadThread_.joinable())
+        {
+            reloadThread_.join();
+        }
+        reloadThread_ = BackgroundThread([this]()
+        {
+            while (true)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(reloadMutex_);
+                    if (!reloadPending_)
+                    {
+                        reloading_ = false;
+                        return;
+                    }
+                    reloadPending_ = false;
+                }
+                loadFromFile(path_);
+            }
+        });
+    }
+
+    std::shared_ptr<const CredentialTable> table_;
+    std::atomic<uint64_t> version_{0};
+    std::mutex updateMutex_;  // Serializes writers; readers never take it
+
+    std::string path_;
+    std::string fileName_;
+    std::shared_ptr<EventLoop> loop_;
+    int inotifyFd_{-1};
+
+    std::mutex reloadMutex_;
+    BackgroundThread reloadThread_;
+    bool reloading_{false};
+    bool reloadPending_{false};
+};
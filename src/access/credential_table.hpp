@@ -0,0 +1,492 @@
+#pragma once
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "access_level.hpp"
+
+struct Credential
+{
+    AccessMask levels;
+    std::string_view userName;  // Points into the owning table's name arena
+};
+
+// One change to a credential table
+struct CredentialChange
+{
+    enum class Op : uint8_t
+    {
+        Add = 1,     // Enroll the card, replacing it if it already exists
+        Remove = 2,
+        Modify = 3   // New access levels for an enrolled card; the name is kept
+    };
+
+    Op op;
+    uint64_t card;
+    AccessMask levels;
+    std::string_view userName;  // Add only
+};
+
+// Header of the compiled credential database. The file is the table itself:
+// the header, the open-addressing slot array and the name arena, laid out so
+// it can be mmap'ed and queried in place without any parsing.
+struct CredentialFileHeader
+{
+    static constexpr char kMagic[8] = {'D', 'O', 'O', 'R', 'C', 'R', 'E', 'D'};
+    static constexpr uint32_t kVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t slotCount;     // Power of two
+    uint64_t cardCount;
+    uint64_t slotsOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+// Immutable open-addressing table of credentials keyed on the raw card value.
+// Slots hold the card, its access levels as a bitmask and an offset into a
+// single arena holding every user name back to back. The slots and arena are
+// either owned by the table or point into a mapped credential database.
+//
+// The key is the frame's bits without its length, so a 26-bit card and a 34-
+// or 37-bit card with the same value are the same credential. Enrollment has
+// to keep such values apart; card lists and the on-disk format carry no
+// length to tell them by.
+class CredentialTable
+{
+    struct Slot
+    {
+        uint64_t card{0};
+        AccessMask levels{0};
+        uint32_t nameOffset{0};
+        uint16_t nameLength{0};
+        uint8_t occupied{0};
+        uint8_t reserved[5]{};
+    };
+    static_assert(sizeof(Slot) == 24, "Slot layout is part of the on-disk format");
+
+public:
+    class Builder
+    {
+    public:
+        void add(uint64_t card, AccessMask levels, std::string_view userName)
+        {
+            userName = userName.substr(0, UINT16_MAX);
+            Slot slot;
+            slot.card = card;
+            slot.levels = levels;
+            slot.nameOffset = static_cast<uint32_t>(names_.size());
+            slot.nameLength = static_cast<uint16_t>(userName.size());
+            slot.occupied = 1;
+            entries_.push_back(slot);
+            names_.append(userName);
+        }
+
+        std::shared_ptr<const CredentialTable> build()
+        {
+            auto table = std::shared_ptr<CredentialTable>(new CredentialTable());
+
+            // Keep the load factor at or below one half
+            size_t capacity = 16;
+            while (capacity < entries_.size() * 2)
+            {
+                capacity *= 2;
+            }
+            table->ownedSlots_.resize(capacity);
+            table->ownedNames_ = std::move(names_);
+            table->slots_ = table->ownedSlots_.data();
+            table->mask_ = capacity - 1;
+            table->names_ = std::string_view(table->ownedNames_);
+
+            for (const auto& entry : entries_)
+            {
+                Slot& slot = table->ownedSlots_[table->probe(entry.card)];
+                if (!slot.occupied)
+                {
+                    table->count_++;
+                }
+                slot = entry;  // Later entries for the same card win
+            }
+            entries_.clear();
+            return table;
+        }
+
+    private:
+        std::vector<Slot> entries_;
+        std::string names_;
+    };
+
+    ~CredentialTable()
+    {
+        if (mapping_)
+        {
+            munmap(mapping_, mappingSize_);
+        }
+    }
+
+    CredentialTable(const CredentialTable&) = delete;
+    CredentialTable& operator=(const CredentialTable&) = delete;
+
+    std::optional<Credential> find(uint64_t card) const
+    {
+        const Slot& slot = slots_[probe(card)];
+        if (!slot.occupied)
+        {
+            return std::nullopt;
+        }
+        std::string_view userName;
+        if (slot.nameOffset <= names_.size())
+        {
+            userName = names_.substr(slot.nameOffset, slot.nameLength);
+        }
+        return Credential{slot.levels, userName};
+    }
+
+    size_t size() const { return count_; }
+
+    // Call fn(card, credential) for every enrolled card, in slot order
+    template <typename Fn>
+    void forEach(Fn&& fn) const
+    {
+        for (uint64_t i = 0; i <= mask_; i++)
+        {
+            const Slot& slot = slots_[i];
+            if (slot.occupied)
+            {
+                fn(slot.card, Credential{slot.levels, names_.substr(slot.nameOffset, slot.nameLength)});
+            }
+        }
+    }
+
+    // Copy of this table with changes applied in order. Costs one copy of
+    // the slots and names rather than a rebuild; the table only grows
+    // (rehashing) when adds push it past half full. Removed names are left
+    // in the arena until they make up most of it.
+    std::shared_ptr<const CredentialTable> withChanges(const std::vector<CredentialChange>& changes) const
+    {
+        size_t adds = 0;
+        for (const auto& change : changes)
+        {
+            adds += change.op == CredentialChange::Op::Add;
+        }
+        size_t capacity = mask_ + 1;
+        while (capacity < (count_ + adds) * 2)
+        {
+            capacity *= 2;
+        }
+
+        // Copy or rehash the live slots, compacting the names on the way
+        // when most of the arena is garbage
+        size_t liveNames = 0;
+        for (uint64_t i = 0; i <= mask_; i++)
+        {
+            liveNames += slots_[i].occupied ? slots_[i].nameLength : 0;
+        }
+        bool compact = names_.size() > kCompactMinimum && names_.size() > 2 * liveNames;
+
+        auto table = std::shared_ptr<CredentialTable>(new CredentialTable());
+        table->ownedSlots_.resize(capacity);
+        table->slots_ = table->ownedSlots_.data();
+        table->mask_ = capacity - 1;
+        table->count_ = count_;
+        if (!compact && capacity == mask_ + 1)
+        {
+            std::copy(slots_, slots_ + capacity, table->ownedSlots_.begin());
+            table->ownedNames_.reserve(names_.size() + changes.size() * 16);
+            table->ownedNames_.assign(names_);
+        }
+        else
+        {
+            table->ownedNames_.reserve(liveNames + changes.size() * 16);
+            for (uint64_t i = 0; i <= mask_; i++)
+            {
+                Slot slot = slots_[i];
+                if (slot.occupied)
+                {
+                    if (compact)
+                    {
+                        std::string_view name = names_.substr(slot.nameOffset, slot.nameLength);
+                        slot.nameOffset = static_cast<uint32_t>(table->ownedNames_.size());
+                        table->ownedNames_.append(name);
+                    }
+                    table->ownedSlots_[table->probe(slot.card)] = slot;
+                }
+            }
+            if (!compact)
+            {
+                table->ownedNames_.assign(names_);
+            }
+        }
+
+        for (const auto& change : changes)
+        {
+            size_t index = table->probe(change.card);
+            Slot& slot = table->ownedSlots_[index];
+            switch (change.op)
+            {
+            case CredentialChange::Op::Add:
+            {
+                std::string_view userName = change.userName.substr(0, UINT16_MAX);
+                table->count_ += !slot.occupied;
+                slot = Slot{};
+                slot.card = change.card;
+                slot.levels = change.levels;
+                slot.nameOffset = static_cast<uint32_t>(table->ownedNames_.size());
+                slot.nameLength = static_cast<uint16_t>(userName.size());
+                slot.occupied = 1;
+                table->ownedNames_.append(userName);
+                break;
+            }
+            case CredentialChange::Op::Modify:
+                if (slot.occupied)
+                {
+                    slot.levels = change.levels;
+                }
+                break;
+            case CredentialChange::Op::Remove:
+                if (slot.occupied)
+                {
+                    table->erase(index);
+                }
+                break;
+            }
+        }
+        table->names_ = std::string_view(table->ownedNames_);
+        return table;
+    }
+
+    // Write the table as a credential database. Goes through a temporary
+    // file and a rename so processes with the old file mapped are unaffected.
+    void writeFile(const std::string& path) const
+    {
+        CredentialFileHeader header{};
+        std::memcpy(header.magic, CredentialFileHeader::kMagic, sizeof(header.magic));
+        header.version = CredentialFileHeader::kVersion;
+        header.slotCount = static_cast<uint32_t>(mask_ + 1);
+        header.cardCount = count_;
+        header.slotsOffset = sizeof(CredentialFileHeader);
+        header.namesOffset = header.slotsOffset + header.slotCount * sizeof(Slot);
+        header.namesSize = names_.size();
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(slots_), header.slotCount * sizeof(Slot));
+            file.write(names_.data(), names_.size());
+            if (!file)
+            {
+                throw std::runtime_error("Failed to write " + tmpPath);
+            }
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            throw std::runtime_error("Failed to rename " + tmpPath + " to " + path);
+        }
+    }
+
+    static bool isDatabaseFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(CredentialFileHeader::kMagic)] = {};
+        file.read(magic, sizeof(magic));
+        return file && std::memcmp(magic, CredentialFileHeader::kMagic, sizeof(magic)) == 0;
+    }
+
+    // Map a credential database read-only and query it in place. Startup cost
+    // doesn't depend on the number of cards, and every process mapping the
+    // same file shares its pages through the page cache.
+    static std::shared_ptr<const CredentialTable> mapFile(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CredentialFileHeader))
+        {
+            close(fd);
+            throw std::runtime_error(path + " is too small to be a credential database");
+        }
+
+        size_t size = st.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Cannot mmap " + path);
+        }
+
+        auto table = std::shared_ptr<CredentialTable>(new CredentialTable());
+        table->mapping_ = mapping;
+        table->mappingSize_ = size;
+
+        const auto* base = static_cast<const char*>(mapping);
+        const auto* header = reinterpret_cast<const CredentialFileHeader*>(base);
+        bool valid = std::memcmp(header->magic, CredentialFileHeader::kMagic, sizeof(header->magic)) == 0 &&
+            header->version == CredentialFileHeader::kVersion &&
+            header->slotCount > 0 && (header->slotCount & (header->slotCount - 1)) == 0 &&
+            header->cardCount < header->slotCount &&
+            header->slotsOffset % alignof(Slot) == 0 &&
+            header->slotsOffset + uint64_t{header->slotCount} * sizeof(Slot) <= header->namesOffset &&
+            header->namesOffset + header->namesSize <= size;
+        if (!valid)
+        {
+            throw std::runtime_error(path + " is not a valid credential database");
+        }
+
+        table->slots_ = reinterpret_cast<const Slot*>(base + header->slotsOffset);
+        table->mask_ = header->slotCount - 1;
+        table->names_ = std::string_view(base + header->namesOffset, header->namesSize);
+        table->count_ = header->cardCount;
+        madvise(mapping, size, MADV_RANDOM);
+        return table;
+    }
+
+private:
+    CredentialTable() = default;
+
+    // splitmix64 finalizer - card values are often sequential, so mix them
+    // before masking to keep probe chains short
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    // Index of the slot holding card, or of the empty slot where it would go
+    size_t probe(uint64_t card) const
+    {
+        for (uint64_t i = hash(card) & mask_;; i = (i + 1) & mask_)
+        {
+            const Slot& slot = slots_[i];
+            if (!slot.occupied || slot.card == card)
+            {
+                return i;
+            }
+        }
+    }
+
+    // Empty slot index and shift back any later entry of its probe chain
+    // that belongs at or before it (backward-shift deletion, so lookups
+    // never need tombstones). Owned tables only.
+    void erase(size_t index)
+    {
+        size_t hole = index;
+        for (size_t next = (hole + 1) & mask_; ownedSlots_[next].occupied; next = (next + 1) & mask_)
+        {
+            size_t home = hash(ownedSlots_[next].card) & mask_;
+            // Distance travelled from home; the entry may fill the hole if
+            // the hole is on its way from home
+            if (((next - home) & mask_) >= ((next - hole) & mask_))
+            {
+                ownedSlots_[hole] = ownedSlots_[next];
+                hole = next;
+            }
+        }
+        ownedSlots_[hole] = Slot{};
+        count_--;
+    }
+
+    static constexpr size_t kCompactMinimum = 64 * 1024;
+
+    const Slot* slots_{nullptr};
+    uint64_t mask_{0};
+    std::string_view names_;
+    size_t count_{0};
+
+    // Storage when built in memory
+    std::vector<Slot> ownedSlots_;
+    std::string ownedNames_;
+
+    // Storage when mapped from a credential database
+    void* mapping_{nullptr};
+    size_t mappingSize_{0};
+};
+
+inline AccessMask parseAccessLevels(const std::vector<std::string>& names, const std::string& card)
+{
+    AccessMask levels = 0;
+    for (const auto& name : names)
+    {
+        AccessLevel level;
+        if (!parseAccessLevel(name, level))
+        {
+            throw std::runtime_error("Unknown access level '" + name + "' for card " + card);
+        }
+        levels |= accessBit(level);
+    }
+    return levels;
+}
+
+// {"cards": [{"card": "0x9d3b9f1a", "name": "Durga", "levels": ["Regular"]}, ...]}
+// Cards may be given as hex/decimal strings or as plain numbers.
+inline void readCredentialsJson(std::istream& in, CredentialTable::Builder& builder)
+{
+    nlohmann::json root = nlohmann::json::parse(in);
+    for (const auto& entry : root.at("cards"))
+    {
+        const auto& card = entry.at("card");
+        uint64_t value = card.is_string()
+            ? std::stoull(card.get<std::string>(), nullptr, 0)
+            : card.get<uint64_t>();
+        auto levels = entry.value("levels", std::vector<std::string>{});
+        builder.add(value, parseAccessLevels(levels, card.dump()), entry.value("name", ""));
+    }
+}
+
+// One card per line: card,name,level|level|...
+// Blank lines and lines starting with '#' are skipped.
+inline void readCredentialsCsv(std::istream& in, CredentialTable::Builder& builder)
+{
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::stringstream row(line);
+        std::string card, name, levelList;
+        std::getline(row, card, ',');
+        std::getline(row, name, ',');
+        std::getline(row, levelList);
+
+        std::vector<std::string> levels;
+        std::stringstream levelStream(levelList);
+        for (std::string level; std::getline(levelStream, level, '|');)
+        {
+            if (!level.empty())
+            {
+                levels.push_back(level);
+            }
+        }
+        builder.add(std::stoull(card, nullptr, 0), parseAccessLevels(levels, card), name);
+    }
+}
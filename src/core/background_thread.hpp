@@ -0,0 +1,123 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+
+// A joinable thread, like std::thread, for work started while the
+// controller runs: door initialization retries and credential reloads. They
+// are often started from the event loop thread, and a new thread would
+// inherit that thread's affinity and, with all memory locked, a fully
+// locked default stack. In real-time mode these threads are created on the
+// cores and with the stack size set by configure() instead.
+class BackgroundThread
+{
+public:
+    BackgroundThread() = default;
+
+    explicit BackgroundThread(std::function<void()> fn)
+    {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        {
+            std::lock_guard<std::mutex> lock(settings().mutex);
+            if (settings().restricted)
+            {
+                pthread_attr_setaffinity_np(&attr, sizeof(settings().cpus), &settings().cpus);
+            }
+            if (settings().stackSize > 0)
+            {
+                pthread_attr_setstacksize(&attr, settings().stackSize);
+            }
+        }
+
+        auto task = std::make_unique<std::function<void()>>(std::move(fn));
+        int rc = pthread_create(&thread_, &attr, &BackgroundThread::run, task.get());
+        pthread_attr_destroy(&attr);
+        if (rc != 0)
+        {
+            throw std::system_error(rc, std::generic_category(), "Cannot start background thread");
+        }
+        task.release();  // Now owned by the thread
+        joinable_ = true;
+    }
+
+    ~BackgroundThread()
+    {
+        if (joinable_)
+        {
+            std::terminate();  // Same as std::thread
+        }
+    }
+
+    BackgroundThread(BackgroundThread&& other) noexcept
+        : thread_(other.thread_)
+        , joinable_(std::exchange(other.joinable_, false))
+    {
+    }
+
+    BackgroundThread& operator=(BackgroundThread&& other) noexcept
+    {
+        if (joinable_)
+        {
+            std::terminate();
+        }
+        thread_ = other.thread_;
+        joinable_ = std::exchange(other.joinable_, false);
+        return *this;
+    }
+
+    bool joinable() const
+    {
+        return joinable_;
+    }
+
+    void join()
+    {
+        pthread_join(thread_, nullptr);
+        joinable_ = false;
+    }
+
+    // Threads started from now on run only on cpus (null keeps the
+    // creator's affinity), with a stack of stackSize bytes (0 keeps the
+    // default). Threads already running keep their settings.
+    static void configure(const cpu_set_t* cpus, size_t stackSize)
+    {
+        std::lock_guard<std::mutex> lock(settings().mutex);
+        settings().restricted = cpus != nullptr;
+        if (cpus)
+        {
+            settings().cpus = *cpus;
+        }
+        settings().stackSize = stackSize;
+    }
+
+private:
+    struct Settings
+    {
+        std::mutex mutex;
+        cpu_set_t cpus;
+        bool restricted{false};
+        size_t stackSize{0};
+    };
+
+    static Settings& settings()
+    {
+        static Settings settings;
+        return settings;
+    }
+
+    static void* run(void* arg)
+    {
+        std::unique_ptr<std::function<void()>> task(static_cast<std::function<void()>*>(arg));
+        (*task)();
+        return nullptr;
+    }
+
+    pthread_t thread_{};
+    bool joinable_{false};
+};
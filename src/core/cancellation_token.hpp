@@ -0,0 +1,58 @@
+#pragma once
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+// A one-way stop request shared by everything that has to notice shutdown.
+// cancel() can come from any thread, or a signal handler, and makes fd()
+// readable for good: the eventfd is never read back, so any epoll set or
+// poll() that includes it wakes straight away, now or later, instead of
+// running into a timeout first.
+class CancellationToken
+{
+public:
+    CancellationToken()
+        : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot create cancellation eventfd");
+        }
+    }
+
+    ~CancellationToken()
+    {
+        close(fd_);
+    }
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    // Async-signal-safe; only the first call writes the eventfd
+    void cancel()
+    {
+        if (!cancelled_.exchange(true))
+        {
+            uint64_t one = 1;
+            ssize_t written = write(fd_, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    bool cancelled() const
+    {
+        return cancelled_.load();
+    }
+
+    // Readable once cancelled; watch it, never read it
+    int fd() const
+    {
+        return fd_;
+    }
+
+private:
+    const int fd_;
+    std::atomic<bool> cancelled_{false};
+};
@@ -1,64 +1,101 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <memory>
-#include <nlohmann/json.hpp>
+#include <vector>
 #include "interfaces.hpp"
+#include "seqlock.hpp"
 
-// Configuration structure for a door
-struct DoorConfig
+// Live state of a door, safe to read from any thread without locking. The
+// flags are packed into one atomic word so each update is a single atomic
+// op and readers always see them together. The last card and event time are
+// published through a seqlock; snapshot() retries around concurrent writes
+// instead of blocking them.
+class DoorState
 {
-    std::string doorId;
-    struct
+public:
+    enum Flag : uint32_t
     {
-        unsigned int data0Pin;
-        unsigned int data1Pin;
-    } reader;
+        Locked = 1 << 0,
+        DoorOpen = 1 << 1,
+        ProximityDetected = 1 << 2,
+        ExitButtonPressed = 1 << 3
+    };
 
-    struct
-    {
-        unsigned int pin;
-        bool activeHigh;
-    } doorSensor;
+    static constexpr size_t kMaxCardLength = 23;
 
-    struct
+    struct Snapshot
     {
-        unsigned int pin;
-        bool activeHigh;
-    } proximitySensor;
+        uint32_t flags;
+        char lastCard[kMaxCardLength + 1];
+        int64_t lastEventTime;  // Seconds since the epoch
 
-    struct
+        bool isLocked() const { return flags & Locked; }
+        bool isDoorOpen() const { return flags & DoorOpen; }
+        bool isProximityDetected() const { return flags & ProximityDetected; }
+        bool isExitButtonPressed() const { return flags & ExitButtonPressed; }
+    };
+
+    bool test(Flag flag) const
     {
-        unsigned int pin;
-        bool activeHigh;
-    } exitButton;
+        return flags_.load(std::memory_order_acquire) & flag;
+    }
 
-    struct
+    // Returns the previous value of the flag
+    bool set(Flag flag, bool value)
     {
-        unsigned int setPin;
-        unsigned int unsetPin;
-    } lock;
-};
+        uint32_t previous = value
+            ? flags_.fetch_or(flag, std::memory_order_acq_rel)
+            : flags_.fetch_and(~static_cast<uint32_t>(flag), std::memory_order_acq_rel);
+        return previous & flag;
+    }
 
-class DoorState
-{
-public:
-    bool isLocked{true};
-    bool isDoorOpen{false};
-    bool isProximityDetected{false};
-    bool isExitButtonPressed{false};
-    std::string lastCardRead;
-    std::chrono::system_clock::time_point lastEventTime;
+    bool isLocked() const { return test(Locked); }
+    bool isDoorOpen() const { return test(DoorOpen); }
+    bool isProximityDetected() const { return test(ProximityDetected); }
+    bool isExitButtonPressed() const { return test(ExitButtonPressed); }
 
-    nlohmann::json toJson() const
+    void recordCard(std::string_view card, std::chrono::system_clock::time_point when)
     {
-        return
+        card = card.substr(0, kMaxCardLength);
+        record_.update([&](Record& record)
         {
-            {"locked", isLocked},
-            {"open", isDoorOpen},
-            {"proximityDetected", isProximityDetected},
-            {"exitButtonPressed", isExitButtonPressed},
-            {"lastCard", lastCardRead},
-            {"lastEventTime", std::chrono::system_clock::to_time_t(lastEventTime)}
-        };
+            std::memcpy(record.lastCard, card.data(), card.size());
+            record.lastCard[card.size()] = '\0';
+            record.lastEventTime = std::chrono::system_clock::to_time_t(when);
+        });
     }
+
+    void recordEvent(std::chrono::system_clock::time_point when)
+    {
+        record_.update([&](Record& record)
+        {
+            record.lastEventTime = std::chrono::system_clock::to_time_t(when);
+        });
+    }
+
+    // Consistent copy of the whole state; never blocks
+    Snapshot snapshot() const
+    {
+        Snapshot snapshot;
+        Record record = record_.load();
+        snapshot.flags = flags_.load(std::memory_order_acquire);
+        std::memcpy(snapshot.lastCard, record.lastCard, sizeof(snapshot.lastCard));
+        snapshot.lastEventTime = record.lastEventTime;
+        return snapshot;
+    }
+
+private:
+    struct Record
+    {
+        char lastCard[kMaxCardLength + 1];
+        int64_t lastEventTime;
+    };
+
+    std::atomic<uint32_t> flags_{Locked};
+    SeqLock<Record> record_{Record{{}, 0}};
 };
@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bounded broadcast ring: any number of threads publish without locks or
+// waiting, and every reader sees every event, in order, through its own
+// cursor. Publishing never waits for readers either. A reader that falls
+// more than a ring behind skips to the oldest event still held and counts
+// what it missed, so the capacity should cover what a reader can fall behind
+// between polls.
+//
+// Each slot carries a stamp, odd while its event is being written, and the
+// event lives in relaxed atomic words like a SeqLock's value, so a reader
+// racing a writer that laps it reads torn words only to throw them away.
+template <typename T>
+class EventBus
+{
+    static_assert(std::is_trivially_copyable_v<T>, "EventBus events are copied word by word");
+
+public:
+    // One subscriber's position on the bus. Poll it from one thread at a
+    // time; the bus must outlive it.
+    class Reader
+    {
+    public:
+        // Hand fn the events published since the last poll, oldest first,
+        // up to max of them; returns how many it got. Stops early at an
+        // event that is still being written.
+        template <typename Fn>
+        size_t poll(Fn&& fn, size_t max = SIZE_MAX)
+        {
+            size_t delivered = 0;
+            while (delivered < max)
+            {
+                const Slot& slot = bus_->slots_[next_ & bus_->mask_];
+                uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+                uint64_t expected = 2 * next_ + 2;
+                if (stamp < expected)
+                {
+                    break;  // Not published yet, or being written
+                }
+                if (stamp == expected)
+                {
+                    T event = loadWords(slot);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.stamp.load(std::memory_order_relaxed) == expected)
+                    {
+                        fn(static_cast<const T&>(event));
+                        next_++;
+                        delivered++;
+                        continue;
+                    }
+                }
+
+                // Overwritten by a later lap
+                uint64_t oldest = bus_->next_.load(std::memory_order_acquire) - bus_->slots_.size();
+                lost_ += oldest - next_;
+                next_ = oldest;
+            }
+            return delivered;
+        }
+
+        // Events skipped because this reader fell a ring behind
+        uint64_t lost() const
+        {
+            return lost_;
+        }
+
+    private:
+        friend class EventBus;
+
+        Reader(const EventBus& bus, uint64_t next)
+            : bus_(&bus)
+            , next_(next)
+        {
+        }
+
+        const EventBus* bus_;
+        uint64_t next_;
+        uint64_t lost_{0};
+    };
+
+    explicit EventBus(size_t capacity)
+        : slots_(roundUp(capacity))
+        , mask_(slots_.size() - 1)
+    {
+    }
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // Safe from any thread
+    void publish(const T& event)
+    {
+        uint64_t sequence = next_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots_[sequence & mask_];
+        slot.stamp.store(2 * sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        storeWords(slot, event);
+        slot.stamp.store(2 * sequence + 2, std::memory_order_release);
+    }
+
+    // A reader that sees events published from now on
+    Reader subscribe() const
+    {
+        return Reader(*this, next_.load(std::memory_order_acquire));
+    }
+
+    size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // A stamp of 2n + 2 means the slot holds event n; 0 that it never held one
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> stamp{0};
+        std::atomic<uint64_t> words[kWords];
+    };
+
+    static size_t roundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    static T loadWords(const Slot& slot)
+    {
+        uint64_t words[kWords];
+        for (size_t i = 0; i < kWords; i++)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    static void storeWords(Slot& slot, const T& value)
+    {
+        uint64_t words[kWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < kWords; i++)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<Slot> slots_;
+    const size_t mask_;
+    alignas(64) std::atomic<uint64_t> next_{0};
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "timer_wheel.hpp"
+
+// Single epoll set shared by every door component. Components register the
+// file descriptors they want watched (GPIO line event fds, timers, sockets)
+// and the loop dispatches readiness to the owning component's handler, so the
+// number of threads stays the same no matter how many doors are configured.
+// The loop also turns a shared TimerWheel for deadlines such as door relocks.
+class EventLoop
+{
+public:
+    using Handler = std::function<void(uint32_t events)>;
+
+    EventLoop()
+    {
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd_ < 0)
+        {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd_ < 0)
+        {
+            close(epollFd_);
+            throw std::runtime_error("Failed to create event loop wakeup fd");
+        }
+
+        add(wakeFd_, EPOLLIN, [this](uint32_t)
+        {
+            uint64_t count;
+            while (read(wakeFd_, &count, sizeof(count)) > 0) {}
+            runPendingTasks();
+        });
+    }
+
+    ~EventLoop()
+    {
+        close(wakeFd_);
+        close(epollFd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Watch fd for the given epoll events. Safe to call from any thread.
+    bool add(int fd, uint32_t events, Handler handler)
+    {
+        std::lock_guard<std::mutex> lock(handlersMutex_);
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            return false;
+        }
+        handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+        return true;
+    }
+
+    bool modify(int fd, uint32_t events)
+    {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        return epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    void remove(int fd)
+    {
+        std::lock_guard<std::mutex> lock(handlersMutex_);
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        handlers_.erase(fd);
+    }
+
+    // Queue a task to run on the loop thread and wake the loop up.
+    void post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex_);
+            pendingTasks_.push_back(std::move(task));
+        }
+        wakeup();
+    }
+
+    // Run the task right away when already on the loop thread, otherwise post it.
+    void runInLoop(std::function<void()> task)
+    {
+        if (isInLoopThread())
+        {
+            task();
+        }
+        else
+        {
+            post(std::move(task));
+        }
+    }
+
+    bool isInLoopThread() const
+    {
+        return loopThread_.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+    // Timers must only be armed or cancelled on the loop thread
+    TimerWheel& timers()
+    {
+        return timers_;
+    }
+
+    // Wait up to timeoutMs (-1 blocks) for ready fds or the next timer tick,
+    // then dispatch whatever is ready.
+    void runOnce(int timeoutMs)
+    {
+        // Other threads read this to decide whether to post, so it is only
+        // written when a different thread takes over the loop
+        std::thread::id self = std::this_thread::get_id();
+        if (loopThread_.load(std::memory_order_relaxed) != self)
+        {
+            loopThread_.store(self, std::memory_order_relaxed);
+        }
+
+        int timerTimeout = timers_.timeoutMs(std::chrono::steady_clock::now());
+        if (timerTimeout >= 0 && (timeoutMs < 0 || timerTimeout < timeoutMs))
+        {
+            timeoutMs = timerTimeout;
+        }
+
+        epoll_event events[kMaxEvents];
+        int n = epoll_wait(epollFd_, events, kMaxEvents, timeoutMs);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                return;
+            }
+            throw std::runtime_error("epoll_wait failed");
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            std::shared_ptr<Handler> handler;
+            {
+                std::lock_guard<std::mutex> lock(handlersMutex_);
+                auto it = handlers_.find(events[i].data.fd);
+                if (it == handlers_.end())
+                {
+                    continue;
+                }
+                handler = it->second;
+            }
+            (*handler)(events[i].events);
+        }
+
+        timers_.advance(std::chrono::steady_clock::now());
+    }
+
+    // Dispatch until stop() is called
+    void run()
+    {
+        while (!stopped_.load())
+        {
+            runOnce(-1);
+        }
+    }
+
+    // Safe to call from any thread
+    void stop()
+    {
+        stopped_ = true;
+        wakeup();
+    }
+
+    void wakeup()
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+private:
+    void runPendingTasks()
+    {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex_);
+            tasks.swap(pendingTasks_);
+        }
+        for (auto& task : tasks)
+        {
+            task();
+        }
+    }
+
+    static constexpr int kMaxEvents = 64;
+
+    int epollFd_{-1};
+    int wakeFd_{-1};
+    std::atomic<std::thread::id> loopThread_{};
+    std::atomic<bool> stopped_{false};
+    TimerWheel timers_;
+    std::mutex handlersMutex_;
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+    std::mutex tasksMutex_;
+    std::vector<std::function<void()>> pendingTasks_;
+};
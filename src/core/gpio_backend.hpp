@@ -0,0 +1,71 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One edge on an input line, stamped by whoever detected it (the kernel for
+// real hardware). Timestamps are on the steady_clock timeline.
+struct GpioEdge
+{
+    std::chrono::nanoseconds timestamp;
+    bool rising;
+};
+
+// An input line requested for edge events
+class IGpioInput
+{
+public:
+    virtual ~IGpioInput() = default;
+
+    // Readable while edges are queued; watched by the event loop
+    virtual int eventFd() const = 0;
+
+    // Read up to max queued edges, oldest first. Never blocks; returns 0
+    // once the queue is drained.
+    virtual int readEdges(GpioEdge* edges, int max) = 0;
+
+    // Current raw level of the line, 0 or 1
+    virtual int value() const = 0;
+};
+
+// Output lines requested together. Every write sets all of them at once.
+class IGpioOutputs
+{
+public:
+    virtual ~IGpioOutputs() = default;
+    virtual void setValues(const std::vector<int>& values) = 0;
+};
+
+// Source of GPIO lines for the door components. Lines are addressed by chip
+// name and offset. Failed requests throw. Lines may be requested from
+// several threads at once, e.g. by doors initializing in parallel.
+class IGpioBackend
+{
+public:
+    enum class Edges
+    {
+        Falling,
+        Both
+    };
+
+    struct InputConfig
+    {
+        std::string consumer;
+        Edges edges;
+        bool pullUp;
+    };
+
+    virtual ~IGpioBackend() = default;
+
+    // Request several inputs with one configuration in a single call
+    virtual std::vector<std::unique_ptr<IGpioInput>> requestInputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const InputConfig& config) = 0;
+
+    // Request output lines as one group, driven to the given initial values
+    virtual std::unique_ptr<IGpioOutputs> requestOutputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const std::string& consumer,
+        const std::vector<int>& values) = 0;
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <functional>
+#include <string>
 
 // Base interface for all door components
 class IDoorComponent
@@ -19,6 +21,18 @@ protected:
     std::function<void(const std::string&, const std::string&)> eventCallback;
 };
 
+// Base interface for components that emit events as typed structs, so the
+// receiver can act on them without a serialize/parse round trip
+template <typename Event>
+class ITypedEventEmitter
+{
+public:
+    virtual ~ITypedEventEmitter() = default;
+    virtual void registerCallback(std::function<void(const Event&)> callback) = 0;
+protected:
+    std::function<void(const Event&)> eventCallback;
+};
+
 // Base interface for components that can be controlled
 class IControllable
 {
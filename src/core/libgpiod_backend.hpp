@@ -0,0 +1,137 @@
+#pragma once
+#include <gpiod.hpp>
+#include <fcntl.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gpio_backend.hpp"
+
+// GPIO lines from the kernel through libgpiod. Each chip is opened once and
+// shared by every line requested from it. libgpiod chips are not
+// thread-safe, so requests are serialized.
+class LibgpiodBackend : public IGpioBackend
+{
+public:
+    std::vector<std::unique_ptr<IGpioInput>> requestInputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const InputConfig& config) override
+    {
+        gpiod::line_request request
+        {
+            .consumer = config.consumer,
+            .request_type = config.edges == Edges::Falling
+                ? gpiod::line_request::EVENT_FALLING_EDGE
+                : gpiod::line_request::EVENT_BOTH_EDGES,
+            .flags = config.pullUp ? gpiod::line_request::FLAG_BIAS_PULL_UP : 0
+        };
+
+        std::lock_guard<std::mutex> lock(*mutex_);
+        gpiod::line_bulk lines = openChip(chip)->get_lines(offsets);
+        lines.request(request);
+
+        std::vector<std::unique_ptr<IGpioInput>> inputs;
+        for (unsigned int i = 0; i < lines.size(); i++)
+        {
+            inputs.push_back(std::make_unique<Input>(lines[i], mutex_));
+        }
+        return inputs;
+    }
+
+    std::unique_ptr<IGpioOutputs> requestOutputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const std::string& consumer,
+        const std::vector<int>& values) override
+    {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        gpiod::line_bulk lines = openChip(chip)->get_lines(offsets);
+        lines.request({consumer, gpiod::line_request::DIRECTION_OUTPUT}, values);
+        return std::make_unique<Outputs>(lines);
+    }
+
+private:
+    class Input : public IGpioInput
+    {
+    public:
+        Input(gpiod::line line, std::shared_ptr<std::mutex> chipMutex)
+            : line_(line)
+            , fd_(line_.event_get_fd())
+            , chipMutex_(std::move(chipMutex))
+        {
+            // Non-blocking so edges can be drained until the kernel queue is empty
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        }
+
+        // The chip stays open in the registry, so the line has to be given
+        // back explicitly for it to be requested again
+        ~Input()
+        {
+            std::lock_guard<std::mutex> lock(*chipMutex_);
+            line_.release();
+        }
+
+        int eventFd() const override
+        {
+            return fd_;
+        }
+
+        // Uses the fd-level read so batches land in a stack buffer, not a vector
+        int readEdges(GpioEdge* edges, int max) override
+        {
+            gpiod_line_event events[kEventBatch];
+            int count = gpiod_line_event_read_fd_multiple(fd_, events, std::min(max, kEventBatch));
+            for (int i = 0; i < count; i++)
+            {
+                // Line event timestamps are CLOCK_MONOTONIC (kernel 5.7+), same as steady_clock
+                edges[i].timestamp = std::chrono::seconds(events[i].ts.tv_sec) +
+                    std::chrono::nanoseconds(events[i].ts.tv_nsec);
+                edges[i].rising = events[i].event_type == GPIOD_LINE_EVENT_RISING_EDGE;
+            }
+            return std::max(count, 0);
+        }
+
+        int value() const override
+        {
+            return line_.get_value();
+        }
+
+    private:
+        static constexpr int kEventBatch = 16;
+
+        gpiod::line line_;
+        int fd_;
+        std::shared_ptr<std::mutex> chipMutex_;  // The backend's, which may go first
+    };
+
+    class Outputs : public IGpioOutputs
+    {
+    public:
+        explicit Outputs(gpiod::line_bulk lines)
+            : lines_(lines)
+        {
+        }
+
+        void setValues(const std::vector<int>& values) override
+        {
+            lines_.set_values(values);
+        }
+
+    private:
+        gpiod::line_bulk lines_;
+    };
+
+    std::shared_ptr<gpiod::chip> openChip(const std::string& path)
+    {
+        auto& chip = chips_[path];
+        if (!chip)
+        {
+            chip = std::make_shared<gpiod::chip>(path);
+        }
+        return chip;
+    }
+
+    std::shared_ptr<std::mutex> mutex_{std::make_shared<std::mutex>()};
+    std::map<std::string, std::shared_ptr<gpiod::chip>> chips_;
+};
@@ -0,0 +1,256 @@
+#pragma once
+#include <dirent.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <spdlog/spdlog.h>
+#include "background_thread.hpp"
+
+struct RealtimeOptions
+{
+    int priority{80};  // SCHED_FIFO priority, 1 to 99
+    int cpu{-1};       // Core for the event loop thread; -1 picks the last one
+};
+
+// Optional real-time mode for the event loop thread, which decodes Wiegand
+// edges. Three steps, in this order:
+//
+//   reserveCpu()  First thing in main, before any thread exists: limits the
+//                 process to every other core, so the logging thread, the
+//                 MQTT network thread and everything else started later
+//                 inherit an affinity that keeps them off the loop's core.
+//   enter()       On the loop thread, once everything is set up: pins it to
+//                 its core, switches it to SCHED_FIFO, locks all memory and
+//                 pre-faults the stack, so decoding never waits on the
+//                 scheduler or a page fault.
+//   selfCheck()   Reads back what the kernel actually applied and logs it.
+//
+// Threads started after enter() (door retries, credential reloads) would
+// inherit the loop's core. They are BackgroundThreads, which enter() sets up
+// to run on the other cores with a small stack, since all of it gets locked.
+// The FIFO policy is set with SCHED_RESET_ON_FORK, so they also run at
+// normal priority. selfCheck() only sees the threads running when it is
+// called.
+// Each step logs and carries on if it isn't permitted; without CAP_SYS_NICE
+// and CAP_IPC_LOCK (or matching rlimits) the controller runs as before.
+class RealtimeMode
+{
+public:
+    explicit RealtimeMode(const RealtimeOptions& options)
+        : options_(options)
+    {
+        int cpus = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+        if (options_.cpu < 0)
+        {
+            options_.cpu = cpus - 1;
+        }
+        if (options_.cpu >= cpus || options_.cpu >= CPU_SETSIZE)
+        {
+            throw std::invalid_argument("No CPU " + std::to_string(options_.cpu) + " for real-time mode");
+        }
+        if (options_.priority < sched_get_priority_min(SCHED_FIFO) ||
+            options_.priority > sched_get_priority_max(SCHED_FIFO))
+        {
+            throw std::invalid_argument("Real-time priority must be 1 to 99");
+        }
+    }
+
+    // Logging isn't up yet, so failures are only reported by selfCheck()
+    bool reserveCpu()
+    {
+        cpu_set_t others;
+        if (sched_getaffinity(0, sizeof(others), &others) != 0)
+        {
+            return false;
+        }
+        CPU_CLR(options_.cpu, &others);
+        if (CPU_COUNT(&others) == 0)
+        {
+            return false;  // Nothing left for the other threads
+        }
+        reserved_ = sched_setaffinity(0, sizeof(others), &others) == 0;
+        others_ = others;
+        return reserved_;
+    }
+
+    bool enter()
+    {
+        bool ok = true;
+        BackgroundThread::configure(reserved_ ? &others_ : nullptr, kBackgroundStack);
+
+        cpu_set_t loopCpu;
+        CPU_ZERO(&loopCpu);
+        CPU_SET(options_.cpu, &loopCpu);
+        if (int rc = pthread_setaffinity_np(pthread_self(), sizeof(loopCpu), &loopCpu))
+        {
+            spdlog::error("Cannot pin event loop to CPU {}: {}", options_.cpu, std::strerror(rc));
+            ok = false;
+        }
+
+        sched_param param{};
+        param.sched_priority = options_.priority;
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+        {
+            spdlog::error("Cannot switch event loop to SCHED_FIFO priority {}: {}",
+                options_.priority, std::strerror(errno));
+            ok = false;
+        }
+
+        // Keep freed heap mapped so it stays locked, and serve large
+        // allocations from the locked heap instead of fresh mmaps
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            spdlog::error("Cannot lock memory: {}", std::strerror(errno));
+            ok = false;
+        }
+        prefaultStack();
+        return ok;
+    }
+
+    // True if every setting took effect. Call on the loop thread after enter().
+    bool selfCheck() const
+    {
+        bool ok = true;
+        auto check = [&ok](bool passed, const std::string& what)
+        {
+            if (passed)
+            {
+                spdlog::info("Real-time check passed: {}", what);
+            }
+            else
+            {
+                spdlog::warn("Real-time check FAILED: {}", what);
+                ok = false;
+            }
+        };
+
+        sched_param param{};
+        int policy = sched_getscheduler(0) & ~SCHED_RESET_ON_FORK;
+        sched_getparam(0, &param);
+        check(policy == SCHED_FIFO && param.sched_priority == options_.priority,
+            "event loop runs SCHED_FIFO at priority " + std::to_string(options_.priority) +
+            " (is " + policyName(policy) + " " + std::to_string(param.sched_priority) + ")");
+
+        cpu_set_t affinity;
+        bool pinned = pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity) == 0 &&
+            CPU_COUNT(&affinity) == 1 && CPU_ISSET(options_.cpu, &affinity);
+        check(pinned, "event loop pinned to CPU " + std::to_string(options_.cpu));
+        check(isolatedCpus().count(options_.cpu) > 0,
+            "CPU " + std::to_string(options_.cpu) + " is isolated (boot with isolcpus=" + std::to_string(options_.cpu) + ")");
+
+        int shared = threadsOnCpu();
+        check(reserved_ && shared == 0,
+            "other threads kept off CPU " + std::to_string(options_.cpu) +
+            (shared > 0 ? " (" + std::to_string(shared) + " still allowed on it)" : ""));
+
+        long lockedKb = statusField("VmLck:");
+        check(lockedKb > 0, "memory locked (" + std::to_string(lockedKb) + " kB)");
+        return ok;
+    }
+
+private:
+    // Touch the stack the loop will use so those pages are resident
+    __attribute__((noinline)) static void prefaultStack()
+    {
+        volatile char stack[kStackPrefault];
+        for (size_t i = 0; i < sizeof(stack); i += 4096)
+        {
+            stack[i] = 0;
+        }
+    }
+
+    static std::string policyName(int policy)
+    {
+        switch (policy)
+        {
+        case SCHED_FIFO: return "SCHED_FIFO";
+        case SCHED_RR: return "SCHED_RR";
+        case SCHED_OTHER: return "SCHED_OTHER";
+        default: return "policy " + std::to_string(policy);
+        }
+    }
+
+    // Kernel list of isolated CPUs, e.g. "2-3,5"
+    static std::set<int> isolatedCpus()
+    {
+        std::set<int> cpus;
+        std::ifstream file("/sys/devices/system/cpu/isolated");
+        std::string list;
+        std::getline(file, list);
+        std::stringstream ranges(list);
+        for (std::string range; std::getline(ranges, range, ',');)
+        {
+            if (range.empty())
+            {
+                continue;
+            }
+            size_t dash = range.find('-');
+            int first = std::atoi(range.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++)
+            {
+                cpus.insert(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // Threads of this process other than the caller that may run on the
+    // loop's CPU
+    int threadsOnCpu() const
+    {
+        int count = 0;
+        pid_t self = static_cast<pid_t>(syscall(SYS_gettid));
+        DIR* tasks = opendir("/proc/self/task");
+        if (!tasks)
+        {
+            return -1;
+        }
+        while (dirent* entry = readdir(tasks))
+        {
+            pid_t tid = std::atoi(entry->d_name);
+            cpu_set_t affinity;
+            if (tid > 0 && tid != self && sched_getaffinity(tid, sizeof(affinity), &affinity) == 0 &&
+                CPU_ISSET(options_.cpu, &affinity))
+            {
+                count++;
+            }
+        }
+        closedir(tasks);
+        return count;
+    }
+
+    // A "Name: value kB" line from /proc/self/status
+    static long statusField(const std::string& name)
+    {
+        std::ifstream status("/proc/self/status");
+        for (std::string line; std::getline(status, line);)
+        {
+            if (line.compare(0, name.size(), name) == 0)
+            {
+                return std::atol(line.c_str() + name.size());
+            }
+        }
+        return -1;
+    }
+
+    static constexpr size_t kStackPrefault = 256 * 1024;
+    static constexpr size_t kBackgroundStack = 256 * 1024;
+
+    RealtimeOptions options_;
+    bool reserved_{false};
+    cpu_set_t others_;  // Every core but the loop's, once reserved
+};
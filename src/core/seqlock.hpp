@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Sequence lock around a small trivially copyable value. Readers never block
+// and never make writers wait: they copy the value and retry if a write
+// overlapped the copy. The value lives in relaxed atomic words, so the
+// racing copy is well defined.
+//
+// Writers briefly spin on each other, so writes should be short and rare
+// compared to reads.
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values are copied word by word");
+
+public:
+    SeqLock()
+        : SeqLock(T{})
+    {
+    }
+
+    explicit SeqLock(const T& value)
+    {
+        storeWords(value);
+    }
+
+    T load() const
+    {
+        while (true)
+        {
+            uint32_t before = sequence_.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;  // Write in progress
+            }
+            T value = loadWords();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence_.load(std::memory_order_relaxed) == before)
+            {
+                return value;
+            }
+        }
+    }
+
+    void store(const T& value)
+    {
+        update([&](T& current) { current = value; });
+    }
+
+    // Read-modify-write under the writer side of the lock
+    template <typename Fn>
+    void update(Fn&& fn)
+    {
+        uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        while ((sequence & 1) ||
+            !sequence_.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed))
+        {
+            sequence = sequence_.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        T value = loadWords();
+        fn(value);
+        storeWords(value);
+
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    T loadWords() const
+    {
+        uint64_t words[kWords];
+        for (size_t i = 0; i < kWords; i++)
+        {
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    void storeWords(const T& value)
+    {
+        uint64_t words[kWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < kWords; i++)
+        {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint32_t> sequence_{0};
+    std::atomic<uint64_t> words_[kWords];
+};
@@ -0,0 +1,371 @@
+#pragma once
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "gpio_backend.hpp"
+
+// Standard Wiegand pulse timing
+struct WiegandTiming
+{
+    std::chrono::microseconds pulseWidth{50};
+    std::chrono::microseconds bitInterval{2000};
+};
+
+// GPIO lines that exist only in memory, for exercising the whole door
+// pipeline without hardware. Any chip name and offset can be requested.
+//
+// Input changes are scheduled for an exact steady_clock time and delivered
+// by an injector thread when that time comes. Each edge is stamped with the
+// time it was scheduled for, as the kernel would stamp it, so the decoders
+// see precise timing even if delivery itself is a little late. Changes
+// scheduled in the past are delivered at once.
+//
+// Outputs keep their last value and report every change to an observer, so
+// a test can see when a door's relay is driven.
+class SimulatedGpioBackend : public IGpioBackend
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on the thread that drives the output
+    using OutputObserver = std::function<void(const std::string& chip, unsigned int offset, int value)>;
+
+    SimulatedGpioBackend()
+        : injector_([this]() { run(); })
+    {
+    }
+
+    ~SimulatedGpioBackend()
+    {
+        {
+            std::lock_guard<std::mutex> lock(scheduleMutex_);
+            stopping_ = true;
+        }
+        scheduleCondition_.notify_one();
+        injector_.join();
+    }
+
+    SimulatedGpioBackend(const SimulatedGpioBackend&) = delete;
+    SimulatedGpioBackend& operator=(const SimulatedGpioBackend&) = delete;
+
+    std::vector<std::unique_ptr<IGpioInput>> requestInputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const InputConfig& config) override
+    {
+        std::lock_guard<std::mutex> lock(linesMutex_);
+        for (unsigned int offset : offsets)
+        {
+            auto it = lines_.find({chip, offset});
+            if (it != lines_.end() && it->second->requested)
+            {
+                throw std::runtime_error("Simulated GPIO line " + chip + ":" + std::to_string(offset) + " is busy");
+            }
+        }
+
+        std::vector<std::unique_ptr<IGpioInput>> inputs;
+        for (unsigned int offset : offsets)
+        {
+            auto& line = lines_[{chip, offset}];
+            if (!line)
+            {
+                line = std::make_shared<Line>();
+            }
+
+            // Lines nothing has driven yet idle at their bias level
+            if (!line->driven)
+            {
+                line->level = config.pullUp ? 1 : 0;
+            }
+            line->requested = true;
+            line->fallingOnly = config.edges == Edges::Falling;
+            inputs.push_back(std::make_unique<Input>(line));
+        }
+        return inputs;
+    }
+
+    std::unique_ptr<IGpioOutputs> requestOutputs(const std::string& chip,
+        const std::vector<unsigned int>& offsets,
+        const std::string&,
+        const std::vector<int>& values) override
+    {
+        auto outputs = std::make_unique<Outputs>(*this, chip, offsets);
+        outputs->setValues(values);
+        return outputs;
+    }
+
+    // Set before any output is requested
+    void onOutputChange(OutputObserver observer)
+    {
+        observer_ = std::move(observer);
+    }
+
+    // Drive an input line to level at the given time. Scheduling the level
+    // it already has at that point produces no edge.
+    void setLevel(const std::string& chip, unsigned int offset, int level, Clock::time_point when = Clock::now())
+    {
+        std::shared_ptr<Line> line = findLine(chip, offset);
+        {
+            std::lock_guard<std::mutex> lock(scheduleMutex_);
+            schedule_.push({when, nextSequence_++, std::move(line), level});
+        }
+        scheduleCondition_.notify_one();
+    }
+
+    // Hold an input at level for duration, then return it to the opposite level
+    void pulse(const std::string& chip, unsigned int offset, int level,
+        Clock::duration duration, Clock::time_point when = Clock::now())
+    {
+        setLevel(chip, offset, level, when);
+        setLevel(chip, offset, !level, when + duration);
+    }
+
+    // Clock out a Wiegand frame of length bits, most significant first,
+    // starting at start: every bit is a low pulse on D0 (zero) or D1 (one).
+    // Returns the time of the frame's last edge.
+    Clock::time_point injectWiegand(const std::string& chip,
+        unsigned int data0,
+        unsigned int data1,
+        uint64_t bits,
+        uint8_t length,
+        Clock::time_point start,
+        const WiegandTiming& timing = {})
+    {
+        Clock::time_point last = start;
+        for (uint8_t i = 0; i < length; i++)
+        {
+            bool one = (bits >> (length - 1 - i)) & 1;
+            Clock::time_point at = start + i * timing.bitInterval;
+            pulse(chip, one ? data1 : data0, 0, timing.pulseWidth, at);
+            last = at + timing.pulseWidth;
+        }
+        return last;
+    }
+
+    int outputValue(const std::string& chip, unsigned int offset) const
+    {
+        std::lock_guard<std::mutex> lock(outputsMutex_);
+        auto it = outputValues_.find({chip, offset});
+        return it == outputValues_.end() ? 0 : it->second;
+    }
+
+private:
+    using LineKey = std::pair<std::string, unsigned int>;
+
+    struct Line
+    {
+        Line()
+            : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to create simulated GPIO event fd");
+            }
+        }
+
+        ~Line()
+        {
+            close(fd);
+        }
+
+        // Injector thread only
+        void deliver(Clock::time_point when, int newLevel)
+        {
+            driven = true;
+            if (newLevel == level.exchange(newLevel))
+            {
+                return;
+            }
+            bool rising = newLevel != 0;
+            if (!rising || !fallingOnly)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                edges.push_back({when.time_since_epoch(), rising});
+                uint64_t one = 1;
+                ssize_t ignored = write(fd, &one, sizeof(one));
+                (void)ignored;
+            }
+        }
+
+        std::atomic<int> level{0};
+        std::atomic<bool> driven{false};
+        int fd;
+        std::mutex mutex;
+        std::deque<GpioEdge> edges;
+        std::atomic<bool> requested{false};
+        std::atomic<bool> fallingOnly{false};
+    };
+
+    class Input : public IGpioInput
+    {
+    public:
+        explicit Input(std::shared_ptr<Line> line)
+            : line_(std::move(line))
+        {
+        }
+
+        ~Input()
+        {
+            line_->requested = false;
+        }
+
+        int eventFd() const override
+        {
+            return line_->fd;
+        }
+
+        int readEdges(GpioEdge* edges, int max) override
+        {
+            std::lock_guard<std::mutex> lock(line_->mutex);
+            int count = 0;
+            while (count < max && !line_->edges.empty())
+            {
+                edges[count++] = line_->edges.front();
+                line_->edges.pop_front();
+            }
+
+            // Drained: clear the fd's readiness. Under the lock, so an edge
+            // delivered concurrently always leaves it readable again.
+            if (line_->edges.empty())
+            {
+                uint64_t pending;
+                ssize_t ignored = read(line_->fd, &pending, sizeof(pending));
+                (void)ignored;
+            }
+            return count;
+        }
+
+        int value() const override
+        {
+            return line_->level;
+        }
+
+    private:
+        std::shared_ptr<Line> line_;
+    };
+
+    class Outputs : public IGpioOutputs
+    {
+    public:
+        Outputs(SimulatedGpioBackend& backend, const std::string& chip, const std::vector<unsigned int>& offsets)
+            : backend_(backend)
+            , chip_(chip)
+            , offsets_(offsets)
+            , values_(offsets.size(), -1)
+        {
+        }
+
+        void setValues(const std::vector<int>& values) override
+        {
+            if (values.size() != offsets_.size())
+            {
+                throw std::invalid_argument("Wrong number of simulated GPIO output values");
+            }
+            for (size_t i = 0; i < offsets_.size(); i++)
+            {
+                if (values[i] != values_[i])
+                {
+                    values_[i] = values[i];
+                    backend_.outputChanged(chip_, offsets_[i], values[i]);
+                }
+            }
+        }
+
+    private:
+        SimulatedGpioBackend& backend_;
+        std::string chip_;
+        std::vector<unsigned int> offsets_;
+        std::vector<int> values_;
+    };
+
+    struct Change
+    {
+        Clock::time_point when;
+        uint64_t sequence;  // Keeps changes scheduled for the same time in order
+        std::shared_ptr<Line> line;
+        int level;
+
+        bool operator>(const Change& other) const
+        {
+            return when != other.when ? when > other.when : sequence > other.sequence;
+        }
+    };
+
+    std::shared_ptr<Line> findLine(const std::string& chip, unsigned int offset)
+    {
+        std::lock_guard<std::mutex> lock(linesMutex_);
+        auto& line = lines_[{chip, offset}];
+        if (!line)
+        {
+            line = std::make_shared<Line>();
+        }
+        return line;
+    }
+
+    void outputChanged(const std::string& chip, unsigned int offset, int value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(outputsMutex_);
+            outputValues_[{chip, offset}] = value;
+        }
+        if (observer_)
+        {
+            observer_(chip, offset, value);
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(scheduleMutex_);
+        while (!stopping_)
+        {
+            if (schedule_.empty())
+            {
+                scheduleCondition_.wait(lock);
+                continue;
+            }
+
+            Clock::time_point when = schedule_.top().when;
+            if (when > Clock::now())
+            {
+                scheduleCondition_.wait_until(lock, when);
+                continue;
+            }
+
+            Change change = schedule_.top();
+            schedule_.pop();
+            lock.unlock();
+            change.line->deliver(change.when, change.level);
+            lock.lock();
+        }
+    }
+
+    std::mutex linesMutex_;
+    std::map<LineKey, std::shared_ptr<Line>> lines_;
+
+    mutable std::mutex outputsMutex_;
+    std::map<LineKey, int> outputValues_;
+    OutputObserver observer_;
+
+    std::mutex scheduleMutex_;
+    std::condition_variable scheduleCondition_;
+    std::priority_queue<Change, std::vector<Change>, std::greater<Change>> schedule_;
+    uint64_t nextSequence_{0};
+    bool stopping_{false};
+
+    // Declared last so everything it touches exists before it starts
+    std::thread injector_;
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Elements are constructed once with the queue and reused in place:
+// the producer fills the slot claim() returns and commit()s it, the consumer
+// reads front() and pop()s it. Members that own memory, such as strings,
+// keep their capacity between uses, so a warmed-up queue never allocates.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(roundUp(capacity))
+        , mask_(slots_.size() - 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: the next free slot, or nullptr if the queue is full
+    T* claim()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ == slots_.size())
+        {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ == slots_.size())
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    // Producer: hand the claimed slot to the consumer
+    void commit()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: the oldest element, or nullptr if the queue is empty
+    T* front()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_)
+        {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    // Consumer: release the front slot to the producer
+    void pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Elements waiting; exact only on the producer or consumer thread
+    size_t size() const
+    {
+        size_t head = head_.load(std::memory_order_acquire);
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+private:
+    static size_t roundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    std::vector<T> slots_;
+    const size_t mask_;
+
+    // Each side's index and its cached copy of the other side's share a
+    // cache line that the other side never writes
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t tailCache_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t headCache_{0};
+};
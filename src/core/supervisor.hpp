@@ -0,0 +1,287 @@
+#pragma once
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "event_loop.hpp"
+
+// Runs the controller as several worker processes, each serving its own
+// partition of the doors, so a crash only takes that partition's doors down.
+// A worker is this same program run again with "--partition K/N" added to
+// its arguments, pinned to core K when there are enough cores.
+//
+// A worker that exits is restarted on its own, after a delay that doubles
+// while it keeps failing soon after starting; the others carry on. SIGINT
+// or SIGTERM is passed on to every worker, and run() returns once all of
+// them have exited, so each locks its doors first. A worker still running
+// after kStopTimeout is killed. Workers get SIGTERM if the supervisor dies.
+//
+// Like the stop signals, SIGCHLD has to be blocked before the process starts
+// any thread, or an exit can be delivered to a thread that drops it.
+class Supervisor
+{
+public:
+    // args: the worker's command line, without the partition
+    Supervisor(std::vector<std::string> args, unsigned processes)
+        : args_(std::move(args))
+        , loop_(std::make_shared<EventLoop>())
+        , stopTimer_(loop_->timers(), [this]() { killRemaining(); })
+    {
+        // Workers get the mask main() set up, without SIGCHLD
+        sigprocmask(SIG_BLOCK, nullptr, &workerMask_);
+        sigdelset(&workerMask_, SIGCHLD);
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &signals, nullptr);
+        signalFd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signalFd_ < 0)
+        {
+            throw std::runtime_error("Cannot create supervisor signalfd");
+        }
+
+        for (unsigned i = 0; i < processes; i++)
+        {
+            workers_.push_back(std::make_unique<Worker>(i, loop_->timers(), [this, i]() { spawn(i); }));
+        }
+    }
+
+    ~Supervisor()
+    {
+        close(signalFd_);
+    }
+
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+
+    // Start every worker and supervise them until a stop signal; returns the
+    // exit code
+    int run()
+    {
+        supervisorPid_ = getpid();
+        loop_->add(signalFd_, EPOLLIN, [this](uint32_t) { handleSignals(); });
+        for (unsigned i = 0; i < workers_.size(); i++)
+        {
+            spawn(i);
+        }
+        loop_->run();
+        loop_->remove(signalFd_);
+        return exitCode_;
+    }
+
+private:
+    struct Worker
+    {
+        Worker(unsigned index, TimerWheel& timers, std::function<void()> restart)
+            : index(index)
+            , restartTimer(timers, std::move(restart))
+        {
+        }
+
+        const unsigned index;
+        pid_t pid{-1};
+        std::chrono::steady_clock::time_point started;
+        std::chrono::milliseconds restartDelay{kRestartMin};
+        TimerWheel::Timer restartTimer;
+    };
+
+    void spawn(unsigned index)
+    {
+        Worker& worker = *workers_[index];
+        if (stopping_)
+        {
+            return;
+        }
+
+        // Everything the child needs is built before fork(): between fork()
+        // and exec() it may only make async-signal-safe calls
+        std::vector<std::string> args = args_;
+        args.push_back("--partition");
+        args.push_back(std::to_string(index) + "/" + std::to_string(workers_.size()));
+        std::vector<char*> argv;
+        for (auto& arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bool pin = static_cast<long>(workers_.size()) <= cpus && index < CPU_SETSIZE;
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        if (pin)
+        {
+            CPU_SET(index, &cpu);
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != supervisorPid_)
+            {
+                _exit(1);  // The supervisor died before the line above
+            }
+            if (pin)
+            {
+                sched_setaffinity(0, sizeof(cpu), &cpu);
+            }
+            sigprocmask(SIG_SETMASK, &workerMask_, nullptr);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        if (pid < 0)
+        {
+            spdlog::error("Cannot start worker process {}: {}", index, std::strerror(errno));
+            scheduleRestart(worker);
+            return;
+        }
+
+        worker.pid = pid;
+        worker.started = std::chrono::steady_clock::now();
+        if (pin)
+        {
+            spdlog::info("Started worker process {} (pid {}) on CPU {}", index, pid, index);
+        }
+        else
+        {
+            spdlog::info("Started worker process {} (pid {})", index, pid);
+        }
+    }
+
+    void handleSignals()
+    {
+        signalfd_siginfo info;
+        while (read(signalFd_, &info, sizeof(info)) > 0)
+        {
+            if (info.ssi_signo == SIGCHLD)
+            {
+                reap();
+            }
+            else
+            {
+                stop();
+            }
+        }
+    }
+
+    void reap()
+    {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            auto it = std::find_if(workers_.begin(), workers_.end(),
+                [pid](const auto& worker) { return worker->pid == pid; });
+            if (it == workers_.end())
+            {
+                continue;
+            }
+            Worker& worker = **it;
+            worker.pid = -1;
+
+            if (stopping_)
+            {
+                if (running() == 0)
+                {
+                    stopTimer_.cancel();
+                    loop_->stop();
+                }
+                continue;
+            }
+
+            if (WIFSIGNALED(status))
+            {
+                spdlog::error("Worker process {} (pid {}) was killed by signal {}", worker.index, pid,
+                    WTERMSIG(status));
+            }
+            else
+            {
+                spdlog::error("Worker process {} (pid {}) exited with status {}", worker.index, pid,
+                    WEXITSTATUS(status));
+            }
+            if (std::chrono::steady_clock::now() - worker.started >= kStableAfter)
+            {
+                worker.restartDelay = kRestartMin;
+            }
+            scheduleRestart(worker);
+        }
+    }
+
+    void scheduleRestart(Worker& worker)
+    {
+        spdlog::info("Restarting worker process {} in {} ms", worker.index, worker.restartDelay.count());
+        worker.restartTimer.start(worker.restartDelay);
+        worker.restartDelay = std::min(worker.restartDelay * 2, kRestartMax);
+    }
+
+    void stop()
+    {
+        if (stopping_)
+        {
+            return;
+        }
+        stopping_ = true;
+        spdlog::info("Stopping {} worker processes", running());
+        for (auto& worker : workers_)
+        {
+            worker->restartTimer.cancel();
+            if (worker->pid > 0)
+            {
+                kill(worker->pid, SIGTERM);
+            }
+        }
+        if (running() == 0)
+        {
+            loop_->stop();
+            return;
+        }
+        stopTimer_.start(kStopTimeout);
+    }
+
+    void killRemaining()
+    {
+        for (auto& worker : workers_)
+        {
+            if (worker->pid > 0)
+            {
+                spdlog::error("Worker process {} (pid {}) did not stop, killing it", worker->index, worker->pid);
+                kill(worker->pid, SIGKILL);
+            }
+        }
+        exitCode_ = 1;
+    }
+
+    size_t running() const
+    {
+        return std::count_if(workers_.begin(), workers_.end(), [](const auto& worker) { return worker->pid > 0; });
+    }
+
+    static constexpr std::chrono::milliseconds kRestartMin{1000};
+    static constexpr std::chrono::milliseconds kRestartMax{30000};
+    static constexpr std::chrono::seconds kStableAfter{60};
+    static constexpr std::chrono::seconds kStopTimeout{10};
+
+    std::vector<std::string> args_;
+    std::shared_ptr<EventLoop> loop_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    int signalFd_{-1};
+    sigset_t workerMask_;
+    pid_t supervisorPid_{0};
+    bool stopping_{false};
+    int exitCode_{0};
+    TimerWheel::Timer stopTimer_;
+};
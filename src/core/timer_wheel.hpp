@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// Hierarchical timer wheel driven by the event loop. Timers are intrusive
+// nodes owned by the component that uses them, so arming, pushing back or
+// cancelling a deadline is O(1) and never allocates. Each level has 64 slots;
+// timers too far out for one level sit in a coarser one and cascade down as
+// the wheel turns.
+//
+// Not thread-safe: timers must only be touched from the event loop thread.
+class TimerWheel
+{
+public:
+    class Timer
+    {
+    public:
+        Timer(TimerWheel& wheel, std::function<void()> callback)
+            : wheel_(wheel)
+            , callback_(std::move(callback))
+        {
+        }
+
+        ~Timer()
+        {
+            cancel();
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        // Arm the timer, or move its deadline if it is already armed
+        void start(std::chrono::milliseconds delay)
+        {
+            wheel_.unlink(*this);
+            wheel_.link(*this, delay);
+        }
+
+        void cancel()
+        {
+            wheel_.unlink(*this);
+        }
+
+        bool pending() const
+        {
+            return bucket_ != nullptr;
+        }
+
+    private:
+        friend class TimerWheel;
+
+        TimerWheel& wheel_;
+        std::function<void()> callback_;
+        uint64_t expires_{0};
+        Timer** bucket_{nullptr};
+        Timer* prev_{nullptr};
+        Timer* next_{nullptr};
+    };
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10))
+        : tick_(tick)
+        , start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    bool empty() const
+    {
+        return count_ == 0;
+    }
+
+    // Fire every timer whose deadline is at or before now
+    void advance(std::chrono::steady_clock::time_point now)
+    {
+        uint64_t target = (now - start_) / tick_;
+        if (empty())
+        {
+            // Nothing to fire, so skip straight ahead rather than stepping
+            // through every tick the loop spent idle
+            current_ = std::max(current_, target);
+            return;
+        }
+        while (current_ < target)
+        {
+            step();
+        }
+    }
+
+    // How long the event loop may sleep before the wheel needs to turn, or -1
+    // when nothing is armed. Skips over empty slots so a lone long timer only
+    // wakes the loop at cascade points instead of on every tick.
+    int timeoutMs(std::chrono::steady_clock::time_point now) const
+    {
+        if (empty())
+        {
+            return -1;
+        }
+
+        uint64_t ticks = kSlots - (current_ & kSlotMask);  // Next cascade
+        for (uint64_t k = 1; k < ticks; k++)
+        {
+            if (slots_[0][(current_ + k) & kSlotMask])
+            {
+                ticks = k;
+                break;
+            }
+        }
+
+        auto deadline = start_ + tick_ * (current_ + ticks);
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+        return remaining.count() > 0 ? static_cast<int>(remaining.count()) : 0;
+    }
+
+private:
+    static constexpr unsigned kLevels = 4;
+    static constexpr unsigned kSlotBits = 6;
+    static constexpr uint64_t kSlots = 1 << kSlotBits;
+    static constexpr uint64_t kSlotMask = kSlots - 1;
+
+    // Deadlines are rounded up to a tick boundary measured from now, not from
+    // the last tick processed, so a timer never fires before its delay is up
+    void link(Timer& timer, std::chrono::milliseconds delay)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (empty())
+        {
+            advance(now);
+        }
+
+        auto deadline = now + delay - start_;
+        uint64_t expires = (deadline + tick_ - std::chrono::nanoseconds(1)) / tick_;
+        timer.expires_ = expires > current_ ? expires : current_ + 1;
+        insert(timer);
+        count_++;
+    }
+
+    void unlink(Timer& timer)
+    {
+        if (!timer.bucket_)
+        {
+            return;
+        }
+        remove(timer);
+        count_--;
+    }
+
+    // Place timer in the finest level whose range covers its deadline
+    void insert(Timer& timer)
+    {
+        uint64_t delta = timer.expires_ - current_;
+        unsigned level = 0;
+        while (level + 1 < kLevels && delta >= (uint64_t{1} << (kSlotBits * (level + 1))))
+        {
+            level++;
+        }
+
+        uint64_t expires = timer.expires_;
+        uint64_t maxDelta = (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+        if (delta > maxDelta)
+        {
+            expires = current_ + maxDelta;  // Clamp; re-cascades until due
+        }
+
+        Timer*& head = slots_[level][(expires >> (kSlotBits * level)) & kSlotMask];
+        timer.prev_ = nullptr;
+        timer.next_ = head;
+        if (head)
+        {
+            head->prev_ = &timer;
+        }
+        head = &timer;
+        timer.bucket_ = &head;
+    }
+
+    void remove(Timer& timer)
+    {
+        if (timer.prev_)
+        {
+            timer.prev_->next_ = timer.next_;
+        }
+        else
+        {
+            *timer.bucket_ = timer.next_;
+        }
+        if (timer.next_)
+        {
+            timer.next_->prev_ = timer.prev_;
+        }
+        timer.bucket_ = nullptr;
+        timer.prev_ = nullptr;
+        timer.next_ = nullptr;
+    }
+
+    void step()
+    {
+        current_++;
+
+        // When a level wraps, redistribute the next slot of the level above
+        for (unsigned level = 1; level < kLevels; level++)
+        {
+            if ((current_ & ((uint64_t{1} << (kSlotBits * level)) - 1)) != 0)
+            {
+                break;
+            }
+            Timer*& head = slots_[level][(current_ >> (kSlotBits * level)) & kSlotMask];
+            while (Timer* timer = head)
+            {
+                remove(*timer);
+                insert(*timer);
+            }
+        }
+
+        // Callbacks may re-arm their own timer; that always lands in a later slot
+        Timer*& head = slots_[0][current_ & kSlotMask];
+        while (Timer* timer = head)
+        {
+            unlink(*timer);
+            timer->callback_();
+        }
+    }
+
+    std::chrono::milliseconds tick_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t current_{0};
+    size_t count_{0};
+    Timer* slots_[kLevels][kSlots]{};
+};
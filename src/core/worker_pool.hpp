@@ -0,0 +1,201 @@
+#pragma once
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "../utils/metrics.hpp"
+
+// A fixed set of worker threads ("shards") for work taken off the event
+// loop. Each producer gets a lane, and lanes are spread round-robin over
+// the shards. A lane always runs on the same shard, so its work stays in
+// order, while lanes on different shards run in parallel.
+//
+// The pool doesn't own any queues. Each lane's producer keeps its own
+// (typically an SpscQueue), pushes to it and calls wake(). The shard calls
+// the lane's drain function until every lane on it comes back empty, then
+// sleeps on an eventfd. wake() only writes the eventfd when the shard
+// actually sleeps, so handing work to a busy shard costs no system call.
+//
+// Each shard counts the time it spends draining (worker<N>_busy_ns), so its
+// utilization is the rate of that counter.
+class WorkerPool
+{
+    struct Shard;
+
+public:
+    // Runs up to a batch of the lane's work; returns how much it ran
+    using Drain = std::function<size_t()>;
+
+    class Lane
+    {
+    public:
+        // Call after publishing work to the lane's queue
+        void wake()
+        {
+            // Pairs with the fence in Shard::run(): either the shard sees
+            // the new work, or we see it going to sleep
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (shard_->sleeping.load(std::memory_order_relaxed))
+            {
+                uint64_t one = 1;
+                ssize_t written = write(shard_->wakeFd, &one, sizeof(one));
+                (void)written;
+            }
+        }
+
+        unsigned shard() const
+        {
+            return shard_->index;
+        }
+
+    private:
+        friend class WorkerPool;
+
+        Shard* shard_{nullptr};
+        Drain drain_;
+    };
+
+    explicit WorkerPool(unsigned shards)
+    {
+        if (shards == 0)
+        {
+            throw std::invalid_argument("A worker pool needs at least one shard");
+        }
+        for (unsigned i = 0; i < shards; i++)
+        {
+            shards_.push_back(std::make_unique<Shard>(i));
+        }
+    }
+
+    ~WorkerPool()
+    {
+        stop();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Add every lane before start(). Lanes live as long as the pool, and
+    // whatever their drain functions touch must outlive stop().
+    Lane& addLane(Drain drain)
+    {
+        Shard& shard = *shards_[lanes_.size() % shards_.size()];
+        lanes_.push_back(std::make_unique<Lane>());
+        Lane& lane = *lanes_.back();
+        lane.shard_ = &shard;
+        lane.drain_ = std::move(drain);
+        shard.lanes.push_back(&lane);
+        return lane;
+    }
+
+    void start()
+    {
+        for (auto& shard : shards_)
+        {
+            shard->thread = std::thread([&shard = *shard]() { shard.run(); });
+        }
+        spdlog::info("Worker pool started: {} lanes on {} shards", lanes_.size(), shards_.size());
+    }
+
+    // Finish the work already queued and join the shards
+    void stop()
+    {
+        for (auto& shard : shards_)
+        {
+            shard->stopping.store(true, std::memory_order_release);
+            uint64_t one = 1;
+            ssize_t written = write(shard->wakeFd, &one, sizeof(one));
+            (void)written;
+        }
+        for (auto& shard : shards_)
+        {
+            if (shard->thread.joinable())
+            {
+                shard->thread.join();
+            }
+        }
+    }
+
+    size_t shards() const
+    {
+        return shards_.size();
+    }
+
+private:
+    struct Shard
+    {
+        explicit Shard(unsigned index)
+            : index(index)
+            , wakeFd(eventfd(0, EFD_CLOEXEC))
+            , busy(Metrics::counter("worker" + std::to_string(index) + "_busy_ns"))
+        {
+            if (wakeFd < 0)
+            {
+                throw std::runtime_error("Cannot create worker wakeup eventfd");
+            }
+        }
+
+        ~Shard()
+        {
+            close(wakeFd);
+        }
+
+        void run()
+        {
+            while (!stopping.load(std::memory_order_acquire))
+            {
+                if (drainAll() > 0)
+                {
+                    continue;
+                }
+
+                sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (drainAll() == 0 && !stopping.load(std::memory_order_acquire))
+                {
+                    uint64_t count;
+                    ssize_t got = read(wakeFd, &count, sizeof(count));
+                    (void)got;
+                }
+                sleeping.store(false, std::memory_order_relaxed);
+            }
+            while (drainAll() > 0) {}
+        }
+
+        // One batch from every lane
+        size_t drainAll()
+        {
+            auto start = std::chrono::steady_clock::now();
+            size_t done = 0;
+            for (Lane* lane : lanes)
+            {
+                done += lane->drain_();
+            }
+            if (done > 0)
+            {
+                busy.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count()));
+            }
+            return done;
+        }
+
+        const unsigned index;
+        const int wakeFd;
+        std::vector<Lane*> lanes;
+        std::thread thread;
+        std::atomic<bool> sleeping{false};
+        std::atomic<bool> stopping{false};
+        MetricCounter& busy;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<std::unique_ptr<Lane>> lanes_;
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "../core/event_loop.hpp"
+#include "../utils/metrics.hpp"
+#include "door_config.hpp"
+#include "door_event_bus.hpp"
+
+// Anti-passback and occupancy over the door event bus. A door whose config
+// names an area leads either into it or out of it, and a grant there moves
+// the card in or out. A card can't enter an area it is already in, so a
+// badge passed back out through the entry doesn't let a second person in,
+// and likewise it can't leave an area it has already left. A card that
+// hasn't gone either way since startup may do both. Each area's occupancy is
+// the process-wide area_occupancy gauge, with the area as its label.
+//
+// The engine follows the bus from the event loop thread: allows() first
+// catches up on whatever any door published, so it decides on the state of
+// every door in the area without a broker round trip. A timer keeps it
+// caught up in between, and keeps the occupancy gauges current.
+class AntiPassback
+{
+public:
+    AntiPassback(std::shared_ptr<DoorEventBus> events, std::shared_ptr<EventLoop> loop)
+        : events_(events)
+        , reader_(events->subscribe())
+        , catchUpTimer_(loop->timers(), [this]()
+        {
+            catchUp();
+            catchUpTimer_.start(kCatchUpInterval);
+        })
+        , lost_(Metrics::counter("door_events_lost"))
+    {
+        catchUpTimer_.start(kCatchUpInterval);
+    }
+
+    ~AntiPassback()
+    {
+        catchUpTimer_.cancel();
+    }
+
+    AntiPassback(const AntiPassback&) = delete;
+    AntiPassback& operator=(const AntiPassback&) = delete;
+
+    // door is the door's number on the bus. Add doors before the loop runs.
+    void addDoor(uint16_t door, const AntiPassbackRule& rule)
+    {
+        if (rule.area.empty())
+        {
+            return;
+        }
+        size_t area = 0;
+        while (area < areas_.size() && areas_[area]->name != rule.area)
+        {
+            area++;
+        }
+        if (area == areas_.size())
+        {
+            areas_.push_back(std::make_unique<Area>(rule.area));
+        }
+        if (doors_.size() <= door)
+        {
+            doors_.resize(door + 1);
+        }
+        doors_[door] = Placement{area, rule.entry};
+    }
+
+    // Whether a card may pass through the door now. Call on the loop thread.
+    bool allows(uint16_t door, uint64_t card)
+    {
+        catchUp();
+        if (door >= doors_.size() || !doors_[door])
+        {
+            return true;
+        }
+        const Area& area = *areas_[doors_[door]->area];
+        auto it = area.inside.find(card);
+        return it == area.inside.end() || it->second != doors_[door]->entry;
+    }
+
+private:
+    struct Area
+    {
+        explicit Area(const std::string& name)
+            : name(name)
+            , gauge(Metrics::gauge("area_occupancy", MetricLabel{"area", name}))
+        {
+        }
+
+        std::string name;
+        std::unordered_map<uint64_t, bool> inside;  // Card -> in the area
+        size_t occupancy{0};
+        MetricGauge& gauge;
+    };
+
+    struct Placement
+    {
+        size_t area;
+        bool entry;
+    };
+
+    void catchUp()
+    {
+        uint64_t lostBefore = reader_.lost();
+        reader_.poll([this](const DoorEvent& event) { apply(event); });
+        if (reader_.lost() != lostBefore)
+        {
+            lost_.add(reader_.lost() - lostBefore);
+            spdlog::warn("Anti-passback fell behind and missed {} door events", reader_.lost() - lostBefore);
+        }
+    }
+
+    void apply(const DoorEvent& event)
+    {
+        if (event.kind != DoorEvent::Kind::AccessGranted || event.door >= doors_.size() || !doors_[event.door])
+        {
+            return;
+        }
+        const Placement& placement = *doors_[event.door];
+        Area& area = *areas_[placement.area];
+        auto [it, added] = area.inside.emplace(event.card, placement.entry);
+        bool wasInside = !added && it->second;
+        it->second = placement.entry;
+        if (placement.entry != wasInside)
+        {
+            if (placement.entry)
+            {
+                area.occupancy++;
+            }
+            else
+            {
+                area.occupancy--;
+            }
+            area.gauge.set(static_cast<int64_t>(area.occupancy));
+        }
+    }
+
+    // Well within the time the busiest panel needs to fill the bus
+    static constexpr std::chrono::milliseconds kCatchUpInterval{250};
+
+    std::shared_ptr<DoorEventBus> events_;
+    DoorEventBus::Reader reader_;
+    std::vector<std::unique_ptr<Area>> areas_;
+    std::vector<std::optional<Placement>> doors_;  // By bus door number
+    TimerWheel::Timer catchUpTimer_;
+    MetricCounter& lost_;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include "../access/audit_journal.hpp"
+#include "../core/event_loop.hpp"
+#include "../mqtt/mqtt_client.hpp"
+#include "wiegand_frame.hpp"
+
+// Answers audit queries over MQTT straight from the journal's indexes.
+//
+// Request on audit/query:
+//   {"id": 7, "card": "0x9d3b9f1a", "door": "Front", "from": 1700000000,
+//    "to": 1700086400, "limit": 100, "reply_to": "audit/result/ops"}
+// Every field is optional; times are seconds since the epoch. Results go to
+// reply_to (default audit/result), newest first.
+class AuditService
+{
+public:
+    AuditService(std::shared_ptr<MqttClient> mqtt,
+        std::shared_ptr<AuditJournal> journal,
+        std::shared_ptr<EventLoop> loop)
+        : mqtt_(mqtt)
+        , journal_(journal)
+        , loop_(loop)
+    {
+        // The journal belongs to the event loop thread
+        subscription_ = mqtt_->subscribe(kQueryTopic, [this](std::string_view, std::string_view payload)
+        {
+            if (loop_->isInLoopThread())
+            {
+                handleQuery(payload);
+                return;
+            }
+            loop_->post([this, payload = std::string(payload)]() { handleQuery(payload); });
+        });
+    }
+
+    ~AuditService()
+    {
+        mqtt_->unsubscribe(subscription_);
+    }
+
+    AuditService(const AuditService&) = delete;
+    AuditService& operator=(const AuditService&) = delete;
+
+private:
+    void handleQuery(std::string_view payload)
+    {
+        nlohmann::json request;
+        std::string replyTo = kDefaultReplyTopic;
+        try
+        {
+            request = nlohmann::json::parse(payload);
+            replyTo = request.value("reply_to", replyTo);
+
+            AuditQuery query;
+            query.limit = std::min<size_t>(request.value("limit", size_t{100}), kMaxResults);
+            if (request.contains("card"))
+            {
+                const auto& card = request["card"];
+                query.card = card.is_string()
+                    ? std::stoull(card.get<std::string>(), nullptr, 0)
+                    : card.get<uint64_t>();
+            }
+            if (request.contains("door"))
+            {
+                query.doorIndex = journal_->findDoor(request["door"].get<std::string>());
+                if (!query.doorIndex)
+                {
+                    publishResults(request, replyTo, {});
+                    return;
+                }
+            }
+            if (request.contains("from"))
+            {
+                query.fromMs = request["from"].get<int64_t>() * 1000;
+            }
+            if (request.contains("to"))
+            {
+                query.toMs = request["to"].get<int64_t>() * 1000 + 999;
+            }
+
+            publishResults(request, replyTo, journal_->query(query));
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Bad audit query: {}", e.what());
+            nlohmann::json error{{"error", e.what()}};
+            if (request.is_object() && request.contains("id"))
+            {
+                error["id"] = request["id"];
+            }
+            mqtt_->publish(replyTo, error.dump());
+        }
+    }
+
+    void publishResults(const nlohmann::json& request, const std::string& replyTo,
+        const std::vector<AuditRecord>& records)
+    {
+        nlohmann::json response;
+        if (request.contains("id"))
+        {
+            response["id"] = request["id"];
+        }
+        response["count"] = records.size();
+        auto& list = response["records"] = nlohmann::json::array();
+        for (const auto& record : records)
+        {
+            WiegandHexString hexBuf;
+            list.push_back(
+            {
+                {"sequence", record.sequence},
+                {"timestamp_ms", record.timestampMs},
+                {"door", journal_->doorName(record.doorIndex)},
+                {"card", record.card ? std::string(formatWiegandHex(record.card, record.bitLength, hexBuf)) : ""},
+                {"granted", record.decision == AuditDecision::Granted},
+                {"reason", auditReasonName(record.reason)}
+            });
+        }
+        mqtt_->publish(replyTo, response.dump(), MqttClient::Qos::AtLeastOnce);
+    }
+
+    static constexpr const char* kQueryTopic = "audit/query";
+    static constexpr const char* kDefaultReplyTopic = "audit/result";
+    static constexpr size_t kMaxResults = 1000;
+
+    std::shared_ptr<MqttClient> mqtt_;
+    std::shared_ptr<AuditJournal> journal_;
+    std::shared_ptr<EventLoop> loop_;
+    MqttClient::SubscriptionId subscription_{0};
+};
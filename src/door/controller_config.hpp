@@ -0,0 +1,462 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "../access/access_policy.hpp"
+#include "door_config.hpp"
+
+// What to do when a door fails to come up at startup
+enum class DoorFailurePolicy
+{
+    Exit,     // Stop the controller, as if the whole panel had failed
+    Degrade   // Run the doors that came up and keep retrying the others
+};
+
+struct ControllerConfig
+{
+    std::vector<DoorConfig> doors;
+    std::map<std::string, WeeklySchedule> schedules;
+    DoorFailurePolicy onDoorFailure{DoorFailurePolicy::Degrade};
+    std::chrono::milliseconds retryInterval{30000};
+    PayloadFormat payloadFormat{PayloadFormat::Json};  // Also copied into every door
+};
+
+// Which of `partitions` worker processes serves each door (see Supervisor).
+// Doors that share an anti-passback area stay in one process, since the door
+// event bus doesn't reach across processes; otherwise doors are spread
+// evenly, in file order. Fewer partitions are used when there are fewer
+// groups of doors than that.
+inline std::vector<unsigned> partitionDoors(const std::vector<DoorConfig>& doors, unsigned partitions)
+{
+    std::vector<unsigned> assigned(doors.size());
+    std::vector<size_t> load(std::max(partitions, 1u));
+    std::map<std::string, unsigned> areas;  // Area -> its partition
+    for (size_t i = 0; i < doors.size(); i++)
+    {
+        const std::string& area = doors[i].antiPassback.area;
+        auto it = area.empty() ? areas.end() : areas.find(area);
+        if (it != areas.end())
+        {
+            assigned[i] = it->second;
+        }
+        else
+        {
+            assigned[i] = static_cast<unsigned>(std::min_element(load.begin(), load.end()) - load.begin());
+            if (!area.empty())
+            {
+                areas[area] = assigned[i];
+            }
+        }
+        load[assigned[i]]++;
+    }
+    return assigned;
+}
+
+// Reads and validates the door configuration file:
+//
+//   {
+//     "on_door_failure": "degrade",
+//     "retry_interval_ms": 30000,
+//     "payload_format": "json",
+//     "schedules": {
+//       "business_hours": {
+//         "weekly": [{"days": ["mon", "tue", "wed", "thu", "fri"], "from": "08:00", "to": "18:00"}],
+//         "holidays": ["2026-12-25"]
+//       }
+//     },
+//     "doors": [
+//       {
+//         "id": "Front",
+//         "reader": {"data0": 22, "data1": 27},
+//         "door_sensor": {"pin": 16, "active_high": false},
+//         "proximity_sensor": {"pin": 23, "active_high": true},
+//         "exit_button": {"pin": 24, "active_high": true, "debounce_ms": 20},
+//         "lock": {"set": 25, "unset": 26},
+//         "access": {"Regular": "business_hours", "ITAR": "always"},
+//         "anti_passback": {"area": "Lab", "direction": "entry"},
+//         "relock_delay_ms": 5000
+//       }
+//     ]
+//   }
+//
+// Sensors also take storm_edges and storm_window_ms, and doors
+// status_coalesce_ms; anything left out keeps the DoorConfig default. A door
+// without "access" lets any enrolled card in at any time; "always" is a
+// built-in schedule. A door without "anti_passback" takes no part in it.
+// payload_format is "json", "cbor" or "msgpack".
+// Unknown keys are rejected so typos don't silently fall back to a default.
+// Every problem in the file is reported in one exception rather than just the
+// first, including GPIO pins claimed twice anywhere on the panel.
+class ControllerConfigParser
+{
+public:
+    static ControllerConfig loadFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open door configuration " + path);
+        }
+
+        nlohmann::json root;
+        try
+        {
+            root = nlohmann::json::parse(file);
+        }
+        catch (const nlohmann::json::parse_error& e)
+        {
+            throw std::runtime_error("Invalid JSON in " + path + ": " + e.what());
+        }
+        return parse(root);
+    }
+
+    static ControllerConfig parse(const nlohmann::json& root)
+    {
+        ControllerConfigParser parser;
+        ControllerConfig config = parser.parseRoot(root);
+        if (!parser.errors_.empty())
+        {
+            std::string message = "Invalid door configuration:";
+            for (const auto& error : parser.errors_)
+            {
+                message += "\n  " + error;
+            }
+            throw std::runtime_error(message);
+        }
+        return config;
+    }
+
+private:
+    ControllerConfig parseRoot(const nlohmann::json& root)
+    {
+        ControllerConfig config;
+        if (!root.is_object())
+        {
+            error("", "expected an object");
+            return config;
+        }
+        checkKeys(root, "", {"on_door_failure", "retry_interval_ms", "payload_format", "schedules", "doors"});
+
+        if (root.contains("on_door_failure"))
+        {
+            const auto& policy = root["on_door_failure"];
+            if (policy == "degrade")
+            {
+                config.onDoorFailure = DoorFailurePolicy::Degrade;
+            }
+            else if (policy == "exit")
+            {
+                config.onDoorFailure = DoorFailurePolicy::Exit;
+            }
+            else
+            {
+                error("on_door_failure", "expected \"degrade\" or \"exit\"");
+            }
+        }
+        readDuration(root, "", "retry_interval_ms", config.retryInterval);
+        if (root.contains("payload_format"))
+        {
+            const auto& format = root["payload_format"];
+            if (!format.is_string() || !parsePayloadFormat(format.get<std::string>(), config.payloadFormat))
+            {
+                error("payload_format", "expected \"json\", \"cbor\" or \"msgpack\"");
+            }
+        }
+
+        if (root.contains("schedules"))
+        {
+            const auto& schedules = root["schedules"];
+            if (!schedules.is_object())
+            {
+                error("schedules", "expected an object");
+            }
+            for (const auto& item : schedules.items())
+            {
+                std::string path = "schedules." + item.key();
+                if (item.key() == AccessPolicy::kAlways)
+                {
+                    error(path, "\"always\" is built in");
+                    continue;
+                }
+                try
+                {
+                    config.schedules[item.key()] = parseWeeklySchedule(item.value());
+                }
+                catch (const std::invalid_argument& e)
+                {
+                    error(path, e.what());
+                }
+            }
+        }
+        schedules_ = &config.schedules;
+
+        const auto doors = root.find("doors");
+        if (doors == root.end() || !doors->is_array() || doors->empty())
+        {
+            error("doors", "expected a non-empty array");
+            return config;
+        }
+
+        std::map<std::string, std::string> ids;  // Door ID -> where it was first seen
+        for (size_t i = 0; i < doors->size(); i++)
+        {
+            std::string path = "doors[" + std::to_string(i) + "]";
+            DoorConfig door = parseDoor((*doors)[i], path);
+            door.payloadFormat = config.payloadFormat;
+            if (!door.doorId.empty())
+            {
+                auto [it, added] = ids.emplace(door.doorId, path);
+                if (!added)
+                {
+                    error(path + ".id", "\"" + door.doorId + "\" is already used by " + it->second);
+                }
+            }
+            config.doors.push_back(door);
+        }
+        return config;
+    }
+
+    DoorConfig parseDoor(const nlohmann::json& json, const std::string& path)
+    {
+        DoorConfig door{};
+        if (!json.is_object())
+        {
+            error(path, "expected an object");
+            return door;
+        }
+        checkKeys(json, path, {"id", "reader", "door_sensor", "proximity_sensor", "exit_button",
+            "lock", "access", "anti_passback", "relock_delay_ms", "status_coalesce_ms"});
+
+        // The ID becomes part of MQTT topics and log file names
+        const auto id = json.find("id");
+        if (id == json.end() || !id->is_string() || id->get<std::string>().empty())
+        {
+            error(path + ".id", "expected a non-empty string");
+        }
+        else if (id->get<std::string>().find_first_of("/+#") != std::string::npos)
+        {
+            error(path + ".id", "must not contain '/', '+' or '#'");
+        }
+        else
+        {
+            door.doorId = id->get<std::string>();
+        }
+
+        if (const auto* reader = section(json, path, "reader", {"data0", "data1"}))
+        {
+            readPin(*reader, path + ".reader", "data0", door.reader.data0Pin);
+            readPin(*reader, path + ".reader", "data1", door.reader.data1Pin);
+        }
+        parseSensor(json, path, "door_sensor", door.doorSensor);
+        parseSensor(json, path, "proximity_sensor", door.proximitySensor);
+        parseSensor(json, path, "exit_button", door.exitButton);
+        if (const auto* lock = section(json, path, "lock", {"set", "unset"}))
+        {
+            readPin(*lock, path + ".lock", "set", door.lock.setPin);
+            readPin(*lock, path + ".lock", "unset", door.lock.unsetPin);
+        }
+
+        readDuration(json, path, "relock_delay_ms", door.relockDelay);
+        readDuration(json, path, "status_coalesce_ms", door.statusCoalesceWindow);
+        parseAccess(json, path, door.access);
+        parseAntiPassback(json, path, door.antiPassback);
+        return door;
+    }
+
+    // {"area": "name", "direction": "entry" or "exit"}
+    void parseAntiPassback(const nlohmann::json& door, const std::string& doorPath, AntiPassbackRule& rule)
+    {
+        if (!door.contains("anti_passback"))
+        {
+            return;
+        }
+        const auto* json = section(door, doorPath, "anti_passback", {"area", "direction"});
+        if (!json)
+        {
+            return;
+        }
+
+        std::string path = doorPath + ".anti_passback";
+        const auto area = json->find("area");
+        if (area == json->end() || !area->is_string() || area->get<std::string>().empty())
+        {
+            error(path + ".area", "expected a non-empty string");
+        }
+        else
+        {
+            rule.area = area->get<std::string>();
+        }
+
+        const auto direction = json->find("direction");
+        if (direction != json->end() && *direction == "entry")
+        {
+            rule.entry = true;
+        }
+        else if (direction != json->end() && *direction == "exit")
+        {
+            rule.entry = false;
+        }
+        else
+        {
+            error(path + ".direction", "expected \"entry\" or \"exit\"");
+        }
+    }
+
+    // {"Level name": "schedule name", ...}
+    void parseAccess(const nlohmann::json& door, const std::string& doorPath, std::vector<AccessRule>& rules)
+    {
+        const auto access = door.find("access");
+        if (access == door.end())
+        {
+            return;
+        }
+        std::string path = doorPath + ".access";
+        if (!access->is_object() || access->empty())
+        {
+            error(path, "expected an object of access level to schedule");
+            return;
+        }
+
+        for (const auto& item : access->items())
+        {
+            AccessLevel level;
+            if (!parseAccessLevel(item.key(), level))
+            {
+                error(path + "." + item.key(), "unknown access level");
+                continue;
+            }
+            if (!item.value().is_string() ||
+                (item.value() != AccessPolicy::kAlways && !schedules_->count(item.value().get<std::string>())))
+            {
+                error(path + "." + item.key(), "expected the name of a schedule");
+                continue;
+            }
+            rules.push_back({accessBit(level), item.value().get<std::string>()});
+        }
+    }
+
+    void parseSensor(const nlohmann::json& door, const std::string& doorPath, const char* key, SensorConfig& sensor)
+    {
+        sensor = SensorConfig{};
+        const auto* json = section(door, doorPath, key,
+            {"pin", "active_high", "debounce_ms", "storm_edges", "storm_window_ms"});
+        if (!json)
+        {
+            return;
+        }
+
+        std::string path = doorPath + "." + key;
+        readPin(*json, path, "pin", sensor.pin);
+        const auto activeHigh = json->find("active_high");
+        if (activeHigh == json->end() || !activeHigh->is_boolean())
+        {
+            error(path + ".active_high", "expected true or false");
+        }
+        else
+        {
+            sensor.activeHigh = activeHigh->get<bool>();
+        }
+
+        readDuration(*json, path, "debounce_ms", sensor.debounce);
+        readDuration(*json, path, "storm_window_ms", sensor.stormWindow);
+        if (json->contains("storm_edges"))
+        {
+            const auto& edges = (*json)["storm_edges"];
+            if (!edges.is_number_unsigned() || edges.get<uint64_t>() == 0 || edges.get<uint64_t>() > UINT32_MAX)
+            {
+                error(path + ".storm_edges", "expected a positive integer");
+            }
+            else
+            {
+                sensor.stormEdges = edges.get<unsigned int>();
+            }
+        }
+    }
+
+    // A required sub-object; nullptr (with the error recorded) if it's missing
+    const nlohmann::json* section(const nlohmann::json& parent, const std::string& parentPath,
+        const char* key, std::initializer_list<const char*> keys)
+    {
+        std::string path = parentPath + "." + key;
+        const auto it = parent.find(key);
+        if (it == parent.end() || !it->is_object())
+        {
+            error(path, "expected an object");
+            return nullptr;
+        }
+        checkKeys(*it, path, keys);
+        return &*it;
+    }
+
+    // Record where every pin is claimed; a pin claimed twice is a wiring
+    // error whichever doors it belongs to
+    void readPin(const nlohmann::json& json, const std::string& path, const char* key, unsigned int& pin)
+    {
+        std::string where = path + "." + key;
+        const auto it = json.find(key);
+        if (it == json.end() || !it->is_number_unsigned() || it->get<uint64_t>() > kMaxPin)
+        {
+            error(where, "expected a GPIO line offset from 0 to " + std::to_string(kMaxPin));
+            return;
+        }
+
+        pin = it->get<unsigned int>();
+        auto [claimed, added] = pins_.emplace(pin, where);
+        if (!added)
+        {
+            error(where, "GPIO " + std::to_string(pin) + " is already used by " + claimed->second);
+        }
+    }
+
+    // Optional positive millisecond count; absent keeps the default
+    void readDuration(const nlohmann::json& json, const std::string& path, const char* key,
+        std::chrono::milliseconds& duration)
+    {
+        const auto it = json.find(key);
+        if (it == json.end())
+        {
+            return;
+        }
+        if (!it->is_number_unsigned() || it->get<uint64_t>() == 0 || it->get<uint64_t>() > kMaxDurationMs)
+        {
+            error(join(path, key), "expected a duration from 1 to " + std::to_string(kMaxDurationMs) + " ms");
+            return;
+        }
+        duration = std::chrono::milliseconds(it->get<uint64_t>());
+    }
+
+    void checkKeys(const nlohmann::json& json, const std::string& path, std::initializer_list<const char*> keys)
+    {
+        for (const auto& item : json.items())
+        {
+            if (std::find_if(keys.begin(), keys.end(), [&](const char* key) { return item.key() == key; }) == keys.end())
+            {
+                error(join(path, item.key()), "unknown key");
+            }
+        }
+    }
+
+    static std::string join(const std::string& path, const std::string& key)
+    {
+        return path.empty() ? key : path + "." + key;
+    }
+
+    void error(const std::string& path, const std::string& message)
+    {
+        errors_.push_back((path.empty() ? "(root)" : path) + ": " + message);
+    }
+
+    static constexpr uint64_t kMaxPin = 1023;
+    static constexpr uint64_t kMaxDurationMs = 24 * 60 * 60 * 1000;
+
+    const std::map<std::string, WeeklySchedule>* schedules_{nullptr};
+    std::map<unsigned int, std::string> pins_;  // Pin -> where it was claimed
+    std::vector<std::string> errors_;
+};
@@ -0,0 +1,230 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include "../access/credential_delta.hpp"
+#include "../access/credential_store.hpp"
+#include "../core/event_loop.hpp"
+#include "../mqtt/mqtt_client.hpp"
+#include "../utils/metrics.hpp"
+
+// Keeps the credential store in step with the central server.
+//
+// The server publishes each change to its card list as a delta on
+// credentials/delta/<version> (see CredentialUpdateCodec), and the full list
+// as a retained snapshot on credentials/snapshot. A delta made against the
+// version we hold is applied straight away, so a revoked card stops working
+// as soon as the delta arrives. A delta made against a later version means
+// one was missed: it is held back, and if the missing one hasn't turned up
+// within kGapGrace we ask for a snapshot on credentials/resync with
+//   {"controller": "door_controller", "version": 41}
+// repeating every kResyncRetry until one arrives. Held deltas newer than the
+// snapshot are then applied on top of it.
+class CredentialSync
+{
+public:
+    CredentialSync(std::shared_ptr<MqttClient> mqtt,
+        std::shared_ptr<CredentialStore> store,
+        std::shared_ptr<EventLoop> loop,
+        const std::string& controllerId)
+        : mqtt_(mqtt)
+        , store_(store)
+        , loop_(loop)
+        , controllerId_(controllerId)
+        , resyncTimer_(loop->timers(), [this]() { requestResync(); })
+        , applyLatency_(Metrics::histogram("credential_delta_apply_ns"))
+        , resyncs_(Metrics::counter("credential_resyncs"))
+    {
+        // Held deltas and the resync timer belong to the event loop thread
+        deltaSubscription_ = mqtt_->subscribe(kDeltaTopic, [this](std::string_view, std::string_view payload)
+        {
+            dispatch(payload, &CredentialSync::handleDelta);
+        });
+        snapshotSubscription_ = mqtt_->subscribe(kSnapshotTopic, [this](std::string_view, std::string_view payload)
+        {
+            dispatch(payload, &CredentialSync::handleSnapshot);
+        });
+    }
+
+    ~CredentialSync()
+    {
+        mqtt_->unsubscribe(deltaSubscription_);
+        mqtt_->unsubscribe(snapshotSubscription_);
+        resyncTimer_.cancel();
+    }
+
+    CredentialSync(const CredentialSync&) = delete;
+    CredentialSync& operator=(const CredentialSync&) = delete;
+
+private:
+    using Handler = void (CredentialSync::*)(const std::string&);
+
+    void dispatch(std::string_view payload, Handler handler)
+    {
+        if (loop_->isInLoopThread())
+        {
+            (this->*handler)(std::string(payload));
+            return;
+        }
+        loop_->post([this, handler, payload = std::string(payload)]() { (this->*handler)(payload); });
+    }
+
+    void handleDelta(const std::string& payload)
+    {
+        CredentialUpdate update;
+        try
+        {
+            update = CredentialUpdateCodec::decode(payload);
+            if (update.kind != CredentialUpdate::Kind::Delta)
+            {
+                throw std::runtime_error("snapshot sent as a delta");
+            }
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Bad credential delta: {}", e.what());
+            return;
+        }
+
+        switch (apply(update))
+        {
+        case CredentialStore::DeltaResult::Applied:
+            applyHeld();
+            break;
+        case CredentialStore::DeltaResult::Stale:
+            spdlog::debug("Ignoring credential delta {}, already at {}", update.version, store_->version());
+            break;
+        case CredentialStore::DeltaResult::Gap:
+            hold(update.baseVersion, payload);
+            break;
+        }
+    }
+
+    void handleSnapshot(const std::string& payload)
+    {
+        try
+        {
+            CredentialUpdate update = CredentialUpdateCodec::decode(payload);
+            if (update.kind != CredentialUpdate::Kind::Snapshot)
+            {
+                throw std::runtime_error("delta sent as a snapshot");
+            }
+            uint64_t current = store_->version();
+            if (current != 0 && update.version <= current)
+            {
+                spdlog::debug("Ignoring credential snapshot {}, already at {}", update.version, current);
+                return;
+            }
+
+            CredentialTable::Builder builder;
+            for (const auto& change : update.changes)
+            {
+                builder.add(change.card, change.levels, change.userName);
+            }
+            store_->replace(builder.build(), update.version);
+            spdlog::info("Loaded credential snapshot {} ({} cards)", update.version, update.changes.size());
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Bad credential snapshot: {}", e.what());
+            return;
+        }
+        applyHeld();
+    }
+
+    CredentialStore::DeltaResult apply(const CredentialUpdate& update)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto result = store_->applyDelta(update.baseVersion, update.version, update.changes);
+        if (result == CredentialStore::DeltaResult::Applied)
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            applyLatency_.record(elapsed);
+            spdlog::info("Applied credential delta {} ({} changes) in {} us", update.version,
+                update.changes.size(), std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        }
+        return result;
+    }
+
+    void hold(uint64_t baseVersion, const std::string& payload)
+    {
+        if (held_.size() >= kMaxHeld)
+        {
+            held_.erase(held_.begin());  // The snapshot will cover it
+        }
+        held_[baseVersion] = payload;
+        if (!resyncTimer_.pending())
+        {
+            spdlog::warn("Credential delta from version {} arrived at version {}, waiting for the missing one",
+                baseVersion, store_->version());
+            resyncTimer_.start(kGapGrace);
+        }
+    }
+
+    // Apply held deltas that now follow on from the store's version, and
+    // drop the ones it has moved past
+    void applyHeld()
+    {
+        while (!held_.empty())
+        {
+            uint64_t current = store_->version();
+            held_.erase(held_.begin(), held_.lower_bound(current));
+            auto next = held_.find(current);
+            if (next == held_.end())
+            {
+                break;
+            }
+            std::string payload = std::move(next->second);
+            held_.erase(next);
+            try
+            {
+                apply(CredentialUpdateCodec::decode(payload));
+            }
+            catch (const std::exception&)
+            {
+                // Decoded once already before it was held
+            }
+        }
+
+        if (held_.empty())
+        {
+            resyncTimer_.cancel();
+        }
+    }
+
+    void requestResync()
+    {
+        if (held_.empty())
+        {
+            return;
+        }
+        uint64_t current = store_->version();
+        spdlog::warn("Missed a credential delta after version {}, requesting a snapshot", current);
+        nlohmann::json request = {{"controller", controllerId_}, {"version", current}};
+        mqtt_->publish(kResyncTopic, request.dump(), MqttClient::Qos::AtLeastOnce);
+        resyncs_.add();
+        resyncTimer_.start(kResyncRetry);
+    }
+
+    static constexpr const char* kDeltaTopic = "credentials/delta/+";
+    static constexpr const char* kSnapshotTopic = "credentials/snapshot";
+    static constexpr const char* kResyncTopic = "credentials/resync";
+    static constexpr std::chrono::milliseconds kGapGrace{500};
+    static constexpr std::chrono::milliseconds kResyncRetry{5000};
+    static constexpr size_t kMaxHeld = 256;
+
+    std::shared_ptr<MqttClient> mqtt_;
+    std::shared_ptr<CredentialStore> store_;
+    std::shared_ptr<EventLoop> loop_;
+    std::string controllerId_;
+    std::map<uint64_t, std::string> held_;  // Base version -> encoded delta
+    TimerWheel::Timer resyncTimer_;
+    LatencyHistogram& applyLatency_;
+    MetricCounter& resyncs_;
+    MqttClient::SubscriptionId deltaSubscription_;
+    MqttClient::SubscriptionId snapshotSubscription_;
+};
@@ -1,78 +1,143 @@
 #pragma once
 #include <memory>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
 #include "../core/door_types.hpp"
+#include "../core/event_loop.hpp"
+#include "../core/spsc_queue.hpp"
+#include "../core/worker_pool.hpp"
 #include "../utils/logger.hpp"
+#include "../utils/payload_writer.hpp"
+#include "../utils/metrics.hpp"
 #include <nlohmann/json.hpp>
 #include "wiegand_reader.hpp"
 #include "gpio_sensor.hpp"
 #include "door_lock.hpp"
+#include "door_config.hpp"
+#include "gpio_chip_registry.hpp"
+#include "door_event_bus.hpp"
+#include "anti_passback.hpp"
 #include "../mqtt/mqtt_client.hpp"
-#include <unordered_map>
-
-enum class AccessLevel
-{
-    REGULAR,
-    ITAR,
-    ITAR_SERVER_ROOM
-};
-
-const std::unordered_map<std::string, std::vector<AccessLevel>> ALLOWED_HEX_CARDS =
-{
-    {"0x9d3b9f1a", {AccessLevel::REGULAR}},
-    {"0x1d397065", {AccessLevel::REGULAR, AccessLevel::ITAR, AccessLevel::ITAR_SERVER_ROOM}}
-};
-
-const std::unordered_map<AccessLevel, std::string> ACCESS_LEVEL_NAMES =
-{
-    {AccessLevel::REGULAR, "Regular"},
-    {AccessLevel::ITAR, "ITAR"},
-    {AccessLevel::ITAR_SERVER_ROOM, "ITAR Server Room"}
-};
-
-const std::unordered_map<std::string, std::string> CARD_USER_NAMES =
-{
-    {"0x9d3b9f1a", "Durga"},
-    {"0x1d397065", "Raven"}
-};
+#include "../access/credential_store.hpp"
+#include "../access/audit_journal.hpp"
+#include "../access/access_policy.hpp"
 
+// The loop thread makes every decision and drives the relay. What follows a
+// decision (the log line, the payload and its MQTT publish) is a report. With
+// a worker pool, reports go through a queue to the door's shard, so a slow
+// publish or log call never holds up decoding. Without one they run on the
+// loop as it goes. A pool needs MQTT on its own network thread, since the
+// shards publish.
 class Door
 {
 public:
-    Door(const DoorConfig& config, std::shared_ptr<MqttClient> mqtt)
+    Door(const DoorConfig& config,
+        std::shared_ptr<MqttClient> mqtt,
+        std::shared_ptr<EventLoop> loop,
+        std::shared_ptr<GpioChipRegistry> gpio,
+        std::shared_ptr<CredentialStore> credentials,
+        std::shared_ptr<AuditJournal> audit = nullptr,
+        std::shared_ptr<AccessPolicy> policy = std::make_shared<AccessPolicy>(),
+        std::shared_ptr<WorkerPool> workers = nullptr,
+        std::shared_ptr<DoorEventBus> events = nullptr,
+        std::shared_ptr<AntiPassback> antiPassback = nullptr)
         : config_(config)
+        , accessTopic_("access/" + config.doorId)
+        , statusTopic_("door/" + config.doorId + "/status")
+        , commandTopic_("door/" + config.doorId + "/command")
         , mqtt_(mqtt)
+        , loop_(loop)
+        , credentials_(credentials)
+        , audit_(audit)
+        , policy_(policy)
+        , policyDoor_(policy->addDoor(config.access))
+        , events_(events)
+        , antiPassback_(antiPassback)
+        , decisionLatency_(Metrics::histogram("access_decision_ns", config.doorId))
+        , granted_(Metrics::counter("access_granted", config.doorId))
+        , denied_(Metrics::counter("access_denied", config.doorId))
+        , reportWait_(Metrics::histogram("report_wait_ns", config.doorId))
+        , reportsDropped_(Metrics::counter("reports_dropped", config.doorId))
+        , reportDepth_(Metrics::gauge("report_queue_depth", config.doorId))
+        , statusTimer_(loop->timers(), [this]() { publishStatusNow(); })
+        , relockTimer_(loop->timers(), [this]() { relock(); })
     {
         // Initialize components
         reader_ = std::make_unique<WiegandReader>(config.doorId, 
                                                 config.reader.data0Pin,
-                                                config.reader.data1Pin);
+                                                config.reader.data1Pin,
+                                                loop_,
+                                                gpio);
         
         doorSensor_ = std::make_unique<GpioSensor>(config.doorId,
-                                                  config.doorSensor.pin,
-                                                  config.doorSensor.activeHigh,
-                                                  "door_sensor");
+                                                  config.doorSensor,
+                                                  "door_sensor",
+                                                  loop_,
+                                                  gpio,
+                                                  config.payloadFormat);
         
         proximitySensor_ = std::make_unique<GpioSensor>(config.doorId,
-                                                       config.proximitySensor.pin,
-                                                       config.proximitySensor.activeHigh,
-                                                       "proximity");
+                                                       config.proximitySensor,
+                                                       "proximity",
+                                                       loop_,
+                                                       gpio,
+                                                       config.payloadFormat);
         
         exitButton_ = std::make_unique<GpioSensor>(config.doorId,
-                                                  config.exitButton.pin,
-                                                  config.exitButton.activeHigh,
-                                                  "exit_button");
+                                                  config.exitButton,
+                                                  "exit_button",
+                                                  loop_,
+                                                  gpio,
+                                                  config.payloadFormat);
         
         lock_ = std::make_unique<DoorLock>(config.doorId,
                                             config.lock.setPin,
-                                            config.lock.unsetPin);
+                                            config.lock.unsetPin,
+                                            loop_,
+                                            gpio);
 
         Logger::initialize(config.doorId);
         logger_ = Logger::getDoorLogger(config.doorId);
 
+        if (audit_)
+        {
+            auditDoorIndex_ = audit_->registerDoor(config.doorId);
+        }
+
+        // Anti-passback learns where cards are from the doors' events
+        if (antiPassback_ && !events_)
+        {
+            throw std::invalid_argument("Anti-passback needs the door event bus");
+        }
+        if (events_)
+        {
+            eventDoor_ = events_->registerDoor(config.doorId);
+        }
+        if (antiPassback_)
+        {
+            antiPassback_->addDoor(eventDoor_, config.antiPassback);
+        }
+
+        if (workers)
+        {
+            reports_ = std::make_unique<SpscQueue<Report>>(kReportQueueSize);
+            lane_ = &workers->addLane([this]() { return drainReports(); });
+        }
+
+        // Registered up front so initialize() can run on any thread, and
+        // again after a failure, while the loop serves other doors
+        setupEventHandlers();
         setupMqttHandlers();
     }
 
+    ~Door()
+    {
+        mqtt_->unsubscribe(commandSubscription_);
+    }
+
+    // Request the door's GPIO lines and start watching them. Safe to call
+    // from a thread other than the event loop's, and to retry after it
+    // fails: it only fails before the reader is watched.
     bool initialize()
     {
         bool success = true;
@@ -117,158 +182,395 @@ public:
             }
         }
 
-        setupEventHandlers();
         logger_->info("Door {} initialized with card reader", config_.doorId);
         return true;
     }
 
     void cleanup()
     {
+        stopInputs();
+        if (lock_) lock_->cleanup();
+    }
+
+    // Clean up every door, locking them all with one shared relay pulse
+    // instead of one pulse per door
+    static void cleanupAll(const std::vector<std::unique_ptr<Door>>& doors)
+    {
+        std::vector<DoorLock*> locks;
+        for (const auto& door : doors)
+        {
+            door->stopInputs();
+            if (door->lock_)
+            {
+                locks.push_back(door->lock_.get());
+            }
+        }
+        DoorLock::lockAll(locks);
+    }
+
+    const std::string& id() const
+    {
+        return config_.doorId;
+    }
+
+    // Decide on a card read, act on it and publish the attempt. Called by
+    // the door's reader on the event loop thread.
+    void onCardRead(const CardReadEvent& event)
+    {
+        // Hold the snapshot until the user name it points into is copied. A
+        // misread isn't looked up, so it can't match someone else's card.
+        auto credentials = credentials_->snapshot();
+        auto credential = event.parityValid ? credentials->find(event.value) : std::nullopt;
+        AuditReason reason = handleCardRead(event, credential);
+        report([&](Report& report)
+        {
+            report.kind = Report::Kind::CardRead;
+            report.card = event;
+            report.reason = reason;
+            report.userName.assign(credential ? credential->userName : std::string_view());
+        });
+    }
+
+private:
+    // Filled on the loop thread, consumed by reportNow(). Slots are reused,
+    // so the strings keep their capacity.
+    struct Report
+    {
+        enum class Kind
+        {
+            CardRead,
+            Sensor,
+            Status
+        };
+
+        Kind kind{Kind::Status};
+        std::chrono::steady_clock::time_point queuedAt;
+
+        CardReadEvent card{};
+        AuditReason reason{AuditReason::UnknownCard};
+        std::string userName;
+
+        const std::string* topic{nullptr};  // Sensor topics live as long as the sensor
+        std::string payload;
+        const char* what{""};               // "Door sensor", "Proximity", ...
+        bool fault{false};
+
+        DoorState::Snapshot status{};
+    };
+
+    // Queue a report for the door's shard, or run it here without a pool
+    template <typename Fill>
+    void report(Fill&& fill)
+    {
+        if (!reports_)
+        {
+            fill(inlineReport_);
+            reportNow(inlineReport_);
+            return;
+        }
+
+        Report* slot = reports_->claim();
+        if (!slot)
+        {
+            // The shard has fallen a whole queue behind; the audit journal
+            // still has the decision
+            reportsDropped_.add();
+            if (!reportsBacklogged_)
+            {
+                reportsBacklogged_ = true;
+                logger_->warn("Report queue of door {} is full, dropping reports", config_.doorId);
+            }
+            return;
+        }
+        reportsBacklogged_ = false;
+        fill(*slot);
+        slot->queuedAt = std::chrono::steady_clock::now();
+        reports_->commit();
+        reportDepth_.set(static_cast<int64_t>(reports_->size()));
+        lane_->wake();
+    }
+
+    // On the door's shard
+    size_t drainReports()
+    {
+        size_t count = 0;
+        while (count < kReportBatch)
+        {
+            Report* report = reports_->front();
+            if (!report)
+            {
+                break;
+            }
+            reportWait_.recordSince(report->queuedAt);
+            reportNow(*report);
+            reports_->pop();
+            count++;
+        }
+        if (count > 0)
+        {
+            reportDepth_.set(static_cast<int64_t>(reports_->size()));
+        }
+        return count;
+    }
+
+    void reportNow(const Report& report)
+    {
+        switch (report.kind)
+        {
+        case Report::Kind::CardRead:
+            reportCardRead(report);
+            break;
+        case Report::Kind::Sensor:
+            mqtt_->publish(*report.topic, report.payload, MqttClient::Qos::AtLeastOnce, false, config_.payloadFormat);
+            if (report.fault)
+            {
+                logger_->warn("{} event on door {}: {}", report.what, config_.doorId,
+                    loggablePayload(report.payload, config_.payloadFormat));
+            }
+            else
+            {
+                logger_->info("{} event on door {}: {}", report.what, config_.doorId,
+                    loggablePayload(report.payload, config_.payloadFormat));
+            }
+            break;
+        case Report::Kind::Status:
+            mqtt_->publish(statusTopic_, writeStatus(report.status),
+                MqttClient::Qos::AtMostOnce, false, config_.payloadFormat);
+            break;
+        }
+    }
+
+    void reportCardRead(const Report& report)
+    {
+        const CardReadEvent& event = report.card;
+        WiegandHexString hexBuf;
+        std::string_view hex = formatWiegandHex(event.value, event.bitLength, hexBuf);
+        switch (report.reason)
+        {
+        case AuditReason::CardAccepted:
+            logger_->info("Access GRANTED on door {}: card {} ({} fc={} num={}) user '{}'",
+                config_.doorId, hex, event.format, event.facilityCode, event.cardNumber, report.userName);
+            break;
+        case AuditReason::UnknownCard:
+            logger_->info("Access DENIED on door {}: card {} ({} fc={} num={}) not in whitelist",
+                config_.doorId, hex, event.format, event.facilityCode, event.cardNumber);
+            break;
+        case AuditReason::ParityError:
+            logger_->info("Access DENIED on door {}: card {} ({} fc={} num={}) failed its parity check",
+                config_.doorId, hex, event.format, event.facilityCode, event.cardNumber);
+            break;
+        default:
+            logger_->info("Access DENIED on door {}: card {} ({} fc={} num={}) user '{}' {}",
+                config_.doorId, hex, event.format, event.facilityCode, event.cardNumber, report.userName,
+                report.reason == AuditReason::LevelNotAllowed ? "has no access level for this door"
+                    : report.reason == AuditReason::OutsideSchedule ? "is outside its schedule"
+                    : "would pass back");
+            break;
+        }
+
+        // Serialization happens only after the access decision is made
+        std::string_view message = writeCardRead(event, report.reason == AuditReason::CardAccepted);
+        mqtt_->publish(accessTopic_, message, MqttClient::Qos::AtLeastOnce, false, config_.payloadFormat);
+        SPDLOG_LOGGER_DEBUG(logger_, "Card read event on door {}: {}", config_.doorId,
+            loggablePayload(message, config_.payloadFormat));
+    }
+
+    void reportSensor(const std::string& topic, const std::string& message, const char* what, bool fault)
+    {
+        report([&](Report& report)
+        {
+            report.kind = Report::Kind::Sensor;
+            report.topic = &topic;
+            report.payload.assign(message);
+            report.what = what;
+            report.fault = fault;
+        });
+    }
+
+    void stopInputs()
+    {
+        relockTimer_.cancel();
+        statusTimer_.cancel();
         if (reader_) reader_->cleanup();
         if (doorSensor_) doorSensor_->cleanup();
         if (proximitySensor_) proximitySensor_->cleanup();
         if (exitButton_) exitButton_->cleanup();
-        if (lock_) lock_->cleanup();
     }
 
-private:
     void setupEventHandlers()
     {
         // Card reader events
-        reader_->registerCallback([this](const std::string& topic, const std::string& message)
-        {
-            handleCardRead(message);
-            mqtt_->publish(topic, message);
-            logger_->info("Card read event on door {}: {}", config_.doorId, message);
-        });
+        reader_->registerCallback([this](const CardReadEvent& event) { onCardRead(event); });
 
         // Door sensor events
         doorSensor_->registerCallback([this](const std::string& topic, const std::string& message)
         {
-            state_.isDoorOpen = doorSensor_->getState();
-            mqtt_->publish(topic, message);
-            logger_->info("Door sensor event on door {}: {}", config_.doorId, message);
-            spdlog::info("Door sensor event on door {}: {}", config_.doorId, message);
+            state_.set(DoorState::DoorOpen, doorSensor_->getState());
+            state_.recordEvent(std::chrono::system_clock::now());
+            publishEvent(doorSensor_->getState() ? DoorEvent::Kind::DoorOpened : DoorEvent::Kind::DoorClosed);
+            reportSensor(topic, message, "Door sensor", false);
+            requestStatus();
         });
 
         // Proximity sensor events
         proximitySensor_->registerCallback([this](const std::string& topic, const std::string& message)
         {
-            state_.isProximityDetected = proximitySensor_->getState();
+            state_.set(DoorState::ProximityDetected, proximitySensor_->getState());
+            state_.recordEvent(std::chrono::system_clock::now());
             handleProximityEvent();
-            mqtt_->publish(topic, message);
-            logger_->info("Proximity event on door {}: {}", config_.doorId, message);
+            reportSensor(topic, message, "Proximity", false);
+            requestStatus();
         });
 
         // Exit button events
         exitButton_->registerCallback([this](const std::string& topic, const std::string& message)
         {
-            state_.isExitButtonPressed = exitButton_->getState();
+            state_.set(DoorState::ExitButtonPressed, exitButton_->getState());
+            state_.recordEvent(std::chrono::system_clock::now());
             handleExitButtonEvent();
-            mqtt_->publish(topic, message);
-            logger_->info("Exit button event on door {}: {}", config_.doorId, message);
+            reportSensor(topic, message, "Exit button", false);
+            requestStatus();
         });
+
+        // A sensor that floods edges is suppressed; say so once, and again on recovery
+        for (GpioSensor* sensor : {doorSensor_.get(), proximitySensor_.get(), exitButton_.get()})
+        {
+            sensor->registerFaultCallback([this](const std::string& topic, const std::string& message)
+            {
+                reportSensor(topic, message, "Sensor fault", true);
+            });
+        }
     }
 
     void setupMqttHandlers()
     {
-        mqtt_->subscribe("door/" + config_.doorId + "/command");
-        mqtt_->setMessageHandler([this](const std::string& topic, const std::string& payload)
+        commandSubscription_ = mqtt_->subscribe(commandTopic_,
+            [this](std::string_view topic, std::string_view payload)
         {
-            handleMqttCommand(payload);
+            // Commands touch the lock and its timers, which belong to the event
+            // loop thread; the MQTT network thread, if used, hands them over
+            // with a copy since the payload buffer is gone once we return
+            if (loop_->isInLoopThread())
+            {
+                handleMqttCommand(payload);
+                return;
+            }
+            loop_->post([this, payload = std::string(payload)]() { handleMqttCommand(payload); });
         });
     }
 
-    void handleCardRead(const std::string& message)
+    // Makes the access decision for a card read, records it and unlocks on a
+    // grant. Returns the audit reason, CardAccepted for a grant.
+    AuditReason handleCardRead(const CardReadEvent& event, const std::optional<Credential>& credential)
     {
-        try
-        {
-            nlohmann::json event = nlohmann::json::parse(message);
-            if (event.contains("card") && event["card"].contains("raw"))
-            {
-                std::string rawHexValue = event["card"]["raw"].get<std::string>();
-                logger_->info("Received card read event. Card Raw Hex: {}", rawHexValue);
-                if (ALLOWED_HEX_CARDS.count(rawHexValue) > 0)
-                {
-                    auto cardIt = ALLOWED_HEX_CARDS.find(rawHexValue);
-                    if (cardIt != ALLOWED_HEX_CARDS.end())
-                    {
-                        auto nameIt = CARD_USER_NAMES.find(rawHexValue);
-                        if (nameIt != CARD_USER_NAMES.end())
-                        {
-                            logger_->info("Access GRANTED (Card found in whitelist) to user: {}).", nameIt->second);
-                            spdlog::info("Access GRANTED (Card found in whitelist) to user: {}).", nameIt->second);
-                        }
-                        else
-                        {
-                            logger_->info("Access GRANTED (Card found in whitelist).");
-                            spdlog::info("Access GRANTED (Card found in whitelist).");
-                        }
-
-                        unlockTemporarily();
-                    }
-                }
-                else
-                {
-                    logger_->info("Access DENIED (Card NOT in whitelist).");
-                    spdlog::info("Access DENIED (Card NOT in whitelist).");
-                }
-            }
-            else
-            {
-                logger_->error("Error: JSON message missing 'card' or 'raw' fields.");
-                spdlog::error("Error: JSON message missing 'card' or 'raw' fields.");
-            }
-        }
-        catch (const nlohmann::json::parse_error& e)
-        {
-            logger_->error("JSON Parse Error: {} on message: {}", e.what(), message);
-            spdlog::error("JSON Parse Error: {} on message: {}", e.what(), message);
-        }
-        catch (const nlohmann::json::exception& e)
+        WiegandHexString hexBuf;
+        state_.recordCard(formatWiegandHex(event.value, event.bitLength, hexBuf), event.timestamp);
+
+        // One AND of the card's levels against the door's for the current
+        // 15 minutes. A frame that fails its parity check is denied whatever
+        // it decodes to.
+        auto decision = credential && event.parityValid
+            ? policy_->check(policyDoor_, credential->levels, event.timestamp)
+            : AccessPolicy::Decision::LevelNotAllowed;
+        bool passback = decision == AccessPolicy::Decision::Granted && antiPassback_ &&
+            !antiPassback_->allows(eventDoor_, event.value);
+        decisionLatency_.recordSince(event.lastEdge);
+        if (decision != AccessPolicy::Decision::Granted || passback)
         {
-            logger_->error("JSON Access Error: {}", e.what());
-            spdlog::error("JSON Access Error: {}", e.what());
+            AuditReason reason = !event.parityValid ? AuditReason::ParityError
+                : !credential ? AuditReason::UnknownCard
+                : decision == AccessPolicy::Decision::LevelNotAllowed ? AuditReason::LevelNotAllowed
+                : decision == AccessPolicy::Decision::OutsideSchedule ? AuditReason::OutsideSchedule
+                : AuditReason::AntiPassback;
+            denied_.add();
+            audit(event, AuditDecision::Denied, reason);
+            publishEvent(DoorEvent::Kind::AccessDenied, event.value);
+            return reason;
         }
-        catch (const std::exception& e)
+
+        granted_.add();
+        audit(event, AuditDecision::Granted, AuditReason::CardAccepted);
+        publishEvent(DoorEvent::Kind::AccessGranted, event.value);
+        unlockTemporarily(event.lastEdge);
+        return AuditReason::CardAccepted;
+    }
+
+    void publishEvent(DoorEvent::Kind kind, uint64_t card = 0)
+    {
+        if (events_)
         {
-            logger_->error("Standard Exception: {}", e.what());
-            spdlog::error("Standard Exception: {}", e.what());
+            events_->publish(kind, eventDoor_, card);
         }
     }
 
+    std::string_view writeStatus(const DoorState::Snapshot& status)
+    {
+        return PayloadWriter(statusBuffer_, config_.payloadFormat)
+            .field("locked", status.isLocked())
+            .field("open", status.isDoorOpen())
+            .field("proximityDetected", status.isProximityDetected())
+            .field("exitButtonPressed", status.isExitButtonPressed())
+            .field("lastCard", std::string_view(status.lastCard))
+            .field("lastEventTime", status.lastEventTime)
+            .finish();
+    }
+
+    std::string_view writeCardRead(const CardReadEvent& event, bool granted)
+    {
+        WiegandHexString hexBuf;
+        return PayloadWriter(accessBuffer_, config_.payloadFormat)
+            .field("event", "access_attempt")
+            .field("door_id", config_.doorId)
+            .beginObject("card")
+                .field("raw", formatWiegandHex(event.value, event.bitLength, hexBuf))
+                .field("format", event.format)
+                .field("facility_code", event.facilityCode)
+                .field("number", event.cardNumber)
+            .endObject()
+            .beginObject("access")
+                .field("granted", granted)
+                .field("parity_valid", event.parityValid)
+            .endObject()
+            .field("timestamp", static_cast<int64_t>(std::chrono::system_clock::to_time_t(event.timestamp)))
+            .finish();
+    }
+
     void handleProximityEvent()
     {
-        if (state_.isProximityDetected)
+        if (state_.isProximityDetected())
         {
+            audit(AuditReason::Proximity);
             unlockTemporarily();
         }
     }
 
     void handleExitButtonEvent()
     {
-        if (state_.isExitButtonPressed)
+        if (state_.isExitButtonPressed())
         {
+            audit(AuditReason::ExitButton);
             unlockTemporarily();
         }
     }
 
-    void handleMqttCommand(const std::string& payload)
+    void handleMqttCommand(std::string_view payload)
     {
         try
         {
             auto cmd = nlohmann::json::parse(payload);
             if (cmd["action"] == "unlock")
             {
+                audit(AuditReason::RemoteCommand);
                 unlockTemporarily();
             }
             else if (cmd["action"] == "lock")
             {
-                lock_->setState(true);
+                relockTimer_.cancel();
+                relock();
             }
             else if (cmd["action"] == "status")
             {
-                publishStatus();
+                requestStatus();
             }
         }
         catch (const std::exception& e)
@@ -277,36 +579,114 @@ private:
         }
     }
 
-    void unlockTemporarily()
+    void audit(const CardReadEvent& event, AuditDecision decision, AuditReason reason)
     {
-        lock_->setState(false);
-        state_.isLocked = false;
-        publishStatus();
-
-        // Start a thread to re-lock after delay
-        std::thread([this]()
-        {
-            std::this_thread::sleep_for(std::chrono::seconds(5));
-            lock_->setState(true);
-            state_.isLocked = true;
-            publishStatus();
-        }).detach();
+        if (audit_)
+        {
+            audit_->append(auditDoorIndex_, event.value, event.bitLength, decision, reason, event.timestamp);
+        }
     }
 
-    void publishStatus()
+    // Unlocks that don't involve a card
+    void audit(AuditReason reason)
     {
-        nlohmann::json status = state_.toJson();
-        mqtt_->publish("door/" + config_.doorId + "/status", status.dump());
+        if (audit_)
+        {
+            audit_->append(auditDoorIndex_, 0, 0, AuditDecision::Granted, reason);
+        }
+    }
+
+    // Unlock and (re)arm the single relock deadline. Repeated triggers while
+    // the door is already unlocked only push the deadline back. since is when
+    // the trigger happened, for the relay latency metric.
+    void unlockTemporarily(std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now())
+    {
+        loop_->runInLoop([this, since]()
+        {
+            // Only the caller that actually flips the flag drives the relay
+            if (state_.set(DoorState::Locked, false))
+            {
+                lock_->setStateAsync(false, [this](bool) { publishStatusNow(); }, since);
+            }
+            relockTimer_.start(config_.relockDelay);
+        });
+    }
+
+    void relock()
+    {
+        state_.set(DoorState::Locked, true);
+        lock_->setStateAsync(true, [this](bool) { publishStatusNow(); });
+    }
+
+    // Sensor changes and status requests within one window share a single
+    // snapshot, so a flapping input can't flood the broker
+    void requestStatus()
+    {
+        if (config_.statusCoalesceWindow.count() <= 0)
+        {
+            publishStatusNow();
+        }
+        else if (!statusTimer_.pending())
+        {
+            statusTimer_.start(config_.statusCoalesceWindow);
+        }
+    }
+
+    // Lock transitions skip the window; the snapshot also covers anything
+    // still waiting in it
+    void publishStatusNow()
+    {
+        statusTimer_.cancel();
+        DoorState::Snapshot status = state_.snapshot();
+        report([&status](Report& report)
+        {
+            report.kind = Report::Kind::Status;
+            report.status = status;
+        });
     }
 
     DoorConfig config_;
+    const std::string accessTopic_;
+    const std::string statusTopic_;
+    const std::string commandTopic_;
     DoorState state_;
     std::shared_ptr<spdlog::logger> logger_;
     std::shared_ptr<MqttClient> mqtt_;
+    std::shared_ptr<EventLoop> loop_;
+    std::shared_ptr<CredentialStore> credentials_;
+    std::shared_ptr<AuditJournal> audit_;
+    uint16_t auditDoorIndex_{0};
+    std::shared_ptr<AccessPolicy> policy_;
+    AccessPolicy::DoorHandle policyDoor_;
+    std::shared_ptr<DoorEventBus> events_;
+    uint16_t eventDoor_{0};
+    std::shared_ptr<AntiPassback> antiPassback_;
+    LatencyHistogram& decisionLatency_;
+    MetricCounter& granted_;
+    MetricCounter& denied_;
+    LatencyHistogram& reportWait_;      // Queued until its shard picked it up
+    MetricCounter& reportsDropped_;
+    MetricGauge& reportDepth_;
+    MqttClient::SubscriptionId commandSubscription_{0};
 
     std::unique_ptr<WiegandReader> reader_;
     std::unique_ptr<GpioSensor> doorSensor_;
     std::unique_ptr<GpioSensor> proximitySensor_;
     std::unique_ptr<GpioSensor> exitButton_;
     std::unique_ptr<DoorLock> lock_;
+
+    // Reports; the buffers belong to whichever thread runs them
+    std::unique_ptr<SpscQueue<Report>> reports_;
+    WorkerPool::Lane* lane_{nullptr};
+    Report inlineReport_;
+    bool reportsBacklogged_{false};
+    std::string accessBuffer_;
+    std::string statusBuffer_;
+
+    static constexpr size_t kReportQueueSize = 256;
+    static constexpr size_t kReportBatch = 32;
+
+    // Declared last so they are cancelled before anything they touch is destroyed
+    TimerWheel::Timer statusTimer_;
+    TimerWheel::Timer relockTimer_;
 };
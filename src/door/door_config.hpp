@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../access/access_level.hpp"
+#include "../utils/payload_writer.hpp"
+
+// A door input such as a reed switch or push button
+struct SensorConfig
+{
+    unsigned int pin;
+    bool activeHigh;
+
+    // Edges closer together than this are treated as contact bounce
+    std::chrono::milliseconds debounce{20};
+
+    // More than stormEdges raw edges within stormWindow marks the sensor
+    // faulty; its events are suppressed until a window passes below that
+    unsigned int stormEdges{50};
+    std::chrono::milliseconds stormWindow{1000};
+};
+
+// Anti-passback: the area a grant at the door takes a card into, or out of.
+// An empty area leaves the door out of it.
+struct AntiPassbackRule
+{
+    std::string area;
+    bool entry{true};
+};
+
+// Configuration structure for a door
+struct DoorConfig
+{
+    std::string doorId;
+    struct
+    {
+        unsigned int data0Pin;
+        unsigned int data1Pin;
+    } reader;
+
+    SensorConfig doorSensor;
+    SensorConfig proximitySensor;
+    SensorConfig exitButton;
+
+    struct
+    {
+        unsigned int setPin;
+        unsigned int unsetPin;
+    } lock;
+
+    // How long a door stays unlocked after a grant
+    std::chrono::milliseconds relockDelay{5000};
+
+    // Status changes within this window go out as one snapshot. Lock state
+    // transitions are always published right away.
+    std::chrono::milliseconds statusCoalesceWindow{50};
+
+    // Which access levels may use the door, and when. Empty lets any
+    // enrolled card in at any time.
+    std::vector<AccessRule> access;
+
+    // Encoding of the door's event and status payloads
+    PayloadFormat payloadFormat{PayloadFormat::Json};
+
+    AntiPassbackRule antiPassback;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../core/event_bus.hpp"
+
+// What one door tells the others, in process
+struct DoorEvent
+{
+    enum class Kind : uint8_t
+    {
+        AccessGranted,
+        AccessDenied,
+        DoorOpened,
+        DoorClosed
+    };
+
+    Kind kind;
+    uint16_t door;     // See DoorEventBus::registerDoor()
+    uint64_t card;     // 0 for events without a card
+    std::chrono::steady_clock::time_point time;
+};
+
+// The doors' shared EventBus. Every door publishes its card decisions and
+// door sensor changes here, and features that span doors subscribe instead
+// of going through the broker. Doors are numbered by ID so that events stay
+// one trivially copyable value.
+class DoorEventBus
+{
+public:
+    using Reader = EventBus<DoorEvent>::Reader;
+
+    explicit DoorEventBus(size_t capacity = kDefaultCapacity)
+        : bus_(capacity)
+    {
+    }
+
+    // The number events from this door carry; the same ID always gets the
+    // same number
+    uint16_t registerDoor(const std::string& doorId)
+    {
+        std::lock_guard<std::mutex> lock(doorsMutex_);
+        for (size_t i = 0; i < doorIds_.size(); i++)
+        {
+            if (doorIds_[i] == doorId)
+            {
+                return static_cast<uint16_t>(i);
+            }
+        }
+        if (doorIds_.size() > UINT16_MAX)
+        {
+            throw std::runtime_error("Too many doors on the event bus");
+        }
+        doorIds_.push_back(doorId);
+        return static_cast<uint16_t>(doorIds_.size() - 1);
+    }
+
+    void publish(DoorEvent::Kind kind, uint16_t door, uint64_t card = 0)
+    {
+        bus_.publish({kind, door, card, std::chrono::steady_clock::now()});
+    }
+
+    Reader subscribe() const
+    {
+        return bus_.subscribe();
+    }
+
+private:
+    // A few seconds of every door at its busiest
+    static constexpr size_t kDefaultCapacity = 1024;
+
+    EventBus<DoorEvent> bus_;
+    std::mutex doorsMutex_;
+    std::vector<std::string> doorIds_;
+};
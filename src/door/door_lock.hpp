@@ -1,17 +1,38 @@
 #pragma once
-#include <gpiod.hpp>
 #include <thread>
 #include <chrono>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
 #include <spdlog/spdlog.h>
 #include "../core/interfaces.hpp"
+#include "../core/event_loop.hpp"
+#include "gpio_chip_registry.hpp"
+#include "../utils/metrics.hpp"
 
 class DoorLock : public IDoorComponent, public IControllable
 {
 public:
-    DoorLock(const std::string& doorId, unsigned int setPin, unsigned int unsetPin)
+    // Called once the relay has settled; ok is true if it ended up in the requested state
+    using Completion = std::function<void(bool ok)>;
+
+    DoorLock(const std::string& doorId,
+        unsigned int setPin,
+        unsigned int unsetPin,
+        std::shared_ptr<EventLoop> loop,
+        std::shared_ptr<GpioChipRegistry> gpio)
         : doorId_(doorId)
         , setPin_(setPin)
         , unsetPin_(unsetPin)
+        , loop_(loop)
+        , gpio_(gpio)
+        , outputs_(gpio->outputs())
+        , setIndex_(outputs_.reserve(setPin))
+        , unsetIndex_(outputs_.reserve(unsetPin))
+        , relayLatency_(Metrics::histogram("lock_relay_ns", doorId))
+        , pulseTimer_(loop->timers(), [this]() { endPulse(); })
     {
         // Set pin connects COM to NC
         // Unset pin connects COM to NO
@@ -21,18 +42,10 @@ public:
     {
         try
         {
-            chip_ = std::make_unique<gpiod::chip>("/dev/gpiochip0");
-            setLine_ = chip_->get_line(setPin_);
-            unsetLine_ = chip_->get_line(unsetPin_);
-            
-            // Configure both lines as outputs
-            setLine_.request({"door_lock_set", gpiod::line_request::DIRECTION_OUTPUT});
-            unsetLine_.request({"door_lock_unset", gpiod::line_request::DIRECTION_OUTPUT});
-            
-            // Initialize both lines to low
-            setLine_.set_value(0);
-            unsetLine_.set_value(0);
-            
+            // The first lock to initialize requests the relay lines of every
+            // door at once, all starting low
+            outputs_.request("door_lock");
+
             // Start in locked state
             setState(true);
             return true;
@@ -43,51 +56,240 @@ public:
         }
     }
 
+    // Lock on cleanup. The event loop may already be stopped, so this pulse
+    // is driven synchronously instead of through the timer.
     void cleanup() override
     {
-        setState(true); // Lock on cleanup
+        pulseTimer_.cancel();
+        pulsing_ = false;
+        queuedState_.reset();
+        try
+        {
+            outputs_.set(unsetIndex_, 0);
+            outputs_.set(setIndex_, 1);
+            std::this_thread::sleep_for(kPulseDuration);
+            outputs_.set(setIndex_, 0);
+            currentState_ = true;
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Failed to lock door {} on cleanup: {}", doorId_, e.what());
+        }
+        settle();
+    }
+
+    // Lock every door with one shared pulse: relays on the same chip are
+    // switched together in a single write each way. Like cleanup(), this
+    // blocks for the pulse and must not race pulses driven by the loop.
+    static void lockAll(const std::vector<DoorLock*>& locks)
+    {
+        std::map<GpioOutputBank*, std::vector<size_t>> setLines;
+        std::map<GpioOutputBank*, std::vector<size_t>> unsetLines;
+        for (DoorLock* lock : locks)
+        {
+            lock->pulseTimer_.cancel();
+            lock->pulsing_ = false;
+            lock->queuedState_.reset();
+            setLines[&lock->outputs_].push_back(lock->setIndex_);
+            unsetLines[&lock->outputs_].push_back(lock->unsetIndex_);
+        }
+
+        // Each bank is driven on its own, so one that was never requested or
+        // fails to write doesn't keep the doors on the others unlocked
+        std::set<GpioOutputBank*> pulsed;
+        for (auto& [bank, indices] : setLines)
+        {
+            if (!bank->requested())
+            {
+                continue;
+            }
+            try
+            {
+                bank->set(unsetLines[bank], 0);
+                bank->set(indices, 1);
+                pulsed.insert(bank);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::error("Failed to lock the doors on a GPIO bank: {}", e.what());
+            }
+        }
+        if (!pulsed.empty())
+        {
+            std::this_thread::sleep_for(kPulseDuration);
+        }
+        for (GpioOutputBank* bank : pulsed)
+        {
+            try
+            {
+                bank->set(setLines[bank], 0);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::error("Failed to end the lock pulse on a GPIO bank: {}", e.what());
+            }
+        }
+        for (DoorLock* lock : locks)
+        {
+            if (pulsed.count(&lock->outputs_))
+            {
+                lock->currentState_ = true;
+            }
+        }
+
+        for (DoorLock* lock : locks)
+        {
+            lock->settle();
+        }
     }
 
     bool setState(bool locked) override
     {
+        setStateAsync(locked, nullptr);
+        return true;
+    }
+
+    // Never blocks. The relay line is raised right away and dropped by the
+    // event loop's timer once the pulse has been held long enough. Requests
+    // made while a pulse is in flight are serialized behind it, and only the
+    // most recent one is carried out.
+    //
+    // since is when whatever asked for the change happened, e.g. the last
+    // edge of a card; the time from there until the relay is driven goes
+    // into the lock_relay_ns histogram.
+    void setStateAsync(bool locked, Completion done,
+        std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now())
+    {
+        loop_->runInLoop([this, locked, since, done = std::move(done)]() mutable
+        {
+            if (done)
+            {
+                waiters_.push_back({locked, std::move(done)});
+            }
+
+            if (pulsing_)
+            {
+                queuedState_ = locked;
+                queuedSince_ = since;
+                return;
+            }
+            startPulse(locked, since);
+        });
+    }
+
+    bool getState() const override
+    {
+        return currentState_.load();
+    }
+
+private:
+    struct Waiter
+    {
+        bool locked;
+        Completion done;
+    };
+
+    void startPulse(bool locked, std::chrono::steady_clock::time_point since)
+    {
+        // Latching relay control - pulse the appropriate line. Only ever one
+        // line is high at a time.
         try
         {
-            // Latching relay control - pulse the appropriate line
-            // Since it's a latching relay, we only need to pulse the set or unset line briefly
-            const int pulseDurationMs = 50;
             if (locked)
             {
                 spdlog::info("Locking door {}", doorId_);
-                setLine_.set_value(1);
-                std::this_thread::sleep_for(std::chrono::milliseconds(pulseDurationMs));
-                setLine_.set_value(0);
-            } else
+                outputs_.set(setIndex_, 1);
+            }
+            else
             {
                 spdlog::info("Unlocking door {}", doorId_);
-                unsetLine_.set_value(1);
-                std::this_thread::sleep_for(std::chrono::milliseconds(pulseDurationMs));
-                unsetLine_.set_value(0);
+                outputs_.set(unsetIndex_, 1);
             }
-            currentState_ = locked;
-            return true;
         }
         catch (const std::exception& e)
         {
-            return false;
+            spdlog::error("Failed to pulse lock relay on door {}: {}", doorId_, e.what());
+            settle();
+            return;
         }
+        relayLatency_.recordSince(since);
+
+        pulsing_ = true;
+        pulseTarget_ = locked;
+        pulseTimer_.start(kPulseDuration);
     }
 
-    bool getState() const override
+    void endPulse()
     {
-        return currentState_.load();
+        pulsing_ = false;
+        try
+        {
+            outputs_.set(pulseTarget_ ? setIndex_ : unsetIndex_, 0);
+            currentState_ = pulseTarget_;
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Failed to end lock relay pulse on door {}: {}", doorId_, e.what());
+        }
+
+        // Requests that arrived during the pulse
+        if (queuedState_ && *queuedState_ != currentState_)
+        {
+            bool next = *queuedState_;
+            queuedState_.reset();
+            notifyWaiters(currentState_);
+            startPulse(next, queuedSince_);
+            return;
+        }
+        settle();
     }
 
-private:
+    // Nothing more in flight; everyone still waiting learns the final state
+    void settle()
+    {
+        queuedState_.reset();
+        std::vector<Waiter> waiters;
+        waiters.swap(waiters_);
+        for (auto& waiter : waiters)
+        {
+            waiter.done(waiter.locked == currentState_);
+        }
+    }
+
+    // Complete waiters whose requested state has been reached
+    void notifyWaiters(bool state)
+    {
+        std::vector<Waiter> remaining;
+        std::vector<Waiter> reached;
+        for (auto& waiter : waiters_)
+        {
+            (waiter.locked == state ? reached : remaining).push_back(std::move(waiter));
+        }
+        waiters_.swap(remaining);
+        for (auto& waiter : reached)
+        {
+            waiter.done(true);
+        }
+    }
+
+    static constexpr std::chrono::milliseconds kPulseDuration{50};
+
     std::string doorId_;
     unsigned int setPin_;
     unsigned int unsetPin_;
-    std::unique_ptr<gpiod::chip> chip_;
-    gpiod::line setLine_;
-    gpiod::line unsetLine_;
+    std::shared_ptr<EventLoop> loop_;
+    std::shared_ptr<GpioChipRegistry> gpio_;
+    GpioOutputBank& outputs_;
+    size_t setIndex_;
+    size_t unsetIndex_;
     std::atomic<bool> currentState_{true};
+    LatencyHistogram& relayLatency_;
+
+    // Event loop thread only
+    TimerWheel::Timer pulseTimer_;
+    bool pulsing_{false};
+    bool pulseTarget_{true};
+    std::optional<bool> queuedState_;
+    std::chrono::steady_clock::time_point queuedSince_;
+    std::vector<Waiter> waiters_;
 };
@@ -0,0 +1,184 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "../core/background_thread.hpp"
+#include "../core/cancellation_token.hpp"
+#include "../core/event_loop.hpp"
+#include "controller_config.hpp"
+#include "door.hpp"
+
+// Brings every door up at once, each on its own thread, while the event loop
+// is already running: a door serves cards as soon as its own initialization
+// finishes, however long the others take.
+//
+// Once every door has had its first attempt the failure policy applies.
+// Exit cancels the shutdown token if any door failed. Degrade keeps the
+// doors that came up running and retries the rest every retry interval.
+// Attempts that haven't got going when shutdown starts are skipped.
+class DoorStartup
+{
+public:
+    DoorStartup(const std::vector<std::unique_ptr<Door>>& doors,
+        std::shared_ptr<EventLoop> loop,
+        std::shared_ptr<CancellationToken> shutdown,
+        DoorFailurePolicy policy,
+        std::chrono::milliseconds retryInterval)
+        : doors_(doors)
+        , loop_(loop)
+        , shutdown_(shutdown)
+        , policy_(policy)
+        , retryInterval_(retryInterval)
+        , slots_(doors.size())
+        , retryTimer_(loop->timers(), [this]() { retryFailed(); })
+    {
+    }
+
+    ~DoorStartup()
+    {
+        retryTimer_.cancel();
+        wait();
+    }
+
+    DoorStartup(const DoorStartup&) = delete;
+    DoorStartup& operator=(const DoorStartup&) = delete;
+
+    void start()
+    {
+        started_ = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < slots_.size(); i++)
+        {
+            attempt(i);
+        }
+    }
+
+    // Wait for attempts still in flight. Call after the loop has stopped and
+    // before the doors are cleaned up.
+    void wait()
+    {
+        for (auto& slot : slots_)
+        {
+            if (slot.worker.joinable())
+            {
+                slot.worker.join();
+            }
+        }
+    }
+
+    // True if any door was down after its first attempt and the policy was
+    // to exit. Read once the loop has stopped.
+    bool failed() const
+    {
+        return failed_;
+    }
+
+private:
+    struct Slot
+    {
+        BackgroundThread worker;
+        bool attempting{false};
+        bool up{false};
+    };
+
+    // Slot state belongs to the loop thread (or the caller of start(),
+    // before the loop runs); workers only run Door::initialize()
+    void attempt(size_t index)
+    {
+        Slot& slot = slots_[index];
+        if (slot.worker.joinable())
+        {
+            slot.worker.join();  // Already posted its result, so it has finished
+        }
+        if (shutdown_->cancelled())
+        {
+            return;
+        }
+        slot.attempting = true;
+        slot.worker = BackgroundThread([this, index]()
+        {
+            if (shutdown_->cancelled())
+            {
+                return;
+            }
+            bool up = doors_[index]->initialize();
+            loop_->post([this, index, up]() { finished(index, up); });
+        });
+    }
+
+    void finished(size_t index, bool up)
+    {
+        Slot& slot = slots_[index];
+        slot.attempting = false;
+        slot.up = up;
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started_);
+        if (up)
+        {
+            spdlog::info("Door {} ready {} ms after startup", doors_[index]->id(), elapsed.count());
+        }
+        else
+        {
+            spdlog::error("Failed to initialize door {}", doors_[index]->id());
+        }
+
+        if (!firstRoundDone_ && ++firstRoundFinished_ == slots_.size())
+        {
+            firstRoundDone_ = true;
+            applyPolicy(elapsed);
+        }
+        else if (firstRoundDone_ && !up && !retryTimer_.pending())
+        {
+            retryTimer_.start(retryInterval_);
+        }
+    }
+
+    void applyPolicy(std::chrono::milliseconds elapsed)
+    {
+        size_t down = 0;
+        for (const auto& slot : slots_)
+        {
+            down += slot.up ? 0 : 1;
+        }
+
+        if (down == 0)
+        {
+            spdlog::info("All {} doors initialized in {} ms", slots_.size(), elapsed.count());
+            return;
+        }
+        if (policy_ == DoorFailurePolicy::Exit)
+        {
+            spdlog::error("{} of {} doors failed to initialize, stopping", down, slots_.size());
+            failed_ = true;
+            shutdown_->cancel();
+            return;
+        }
+        spdlog::warn("Running degraded: {} of {} doors failed to initialize, retrying every {} ms",
+            down, slots_.size(), retryInterval_.count());
+        retryTimer_.start(retryInterval_);
+    }
+
+    void retryFailed()
+    {
+        for (size_t i = 0; i < slots_.size(); i++)
+        {
+            if (!slots_[i].up && !slots_[i].attempting)
+            {
+                spdlog::info("Retrying initialization of door {}", doors_[i]->id());
+                attempt(i);
+            }
+        }
+    }
+
+    const std::vector<std::unique_ptr<Door>>& doors_;
+    std::shared_ptr<EventLoop> loop_;
+    std::shared_ptr<CancellationToken> shutdown_;
+    DoorFailurePolicy policy_;
+    std::chrono::milliseconds retryInterval_;
+    std::vector<Slot> slots_;
+    std::chrono::steady_clock::time_point started_;
+    size_t firstRoundFinished_{0};
+    bool firstRoundDone_{false};
+    bool failed_{false};
+    TimerWheel::Timer retryTimer_;
+};
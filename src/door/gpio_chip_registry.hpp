@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../core/gpio_backend.hpp"
+
+// Output lines of one chip, requested together as a single group so any
+// number of them can be driven with one write, e.g. every lock
+// relay in the building at once.
+//
+// Every write sets the whole group, so the bank keeps the last value of
+// each line and always writes them all; setting one door's relay never
+// disturbs another's.
+class GpioOutputBank
+{
+public:
+    GpioOutputBank(std::shared_ptr<IGpioBackend> backend, const std::string& chip)
+        : backend_(std::move(backend))
+        , chip_(chip)
+    {
+    }
+
+    // Add a line before the bank is requested; returns its index in the bank
+    size_t reserve(unsigned int offset)
+    {
+        if (requested_)
+        {
+            throw std::runtime_error("GPIO output bank is already requested");
+        }
+        offsets_.push_back(offset);
+        return offsets_.size() - 1;
+    }
+
+    // Request every reserved line in one call, all driven low. Only the
+    // first call does anything; concurrent callers wait for it.
+    void request(const std::string& consumer)
+    {
+        std::lock_guard<std::mutex> lock(requestMutex_);
+        if (requested_)
+        {
+            return;
+        }
+        values_.assign(offsets_.size(), 0);
+        lines_ = backend_->requestOutputs(chip_, offsets_, consumer, values_);
+        requested_ = true;
+    }
+
+    bool requested() const
+    {
+        return requested_;
+    }
+
+    void set(size_t index, int value)
+    {
+        set(std::vector<size_t>{index}, value);
+    }
+
+    // Drive several lines with a single kernel call
+    void set(const std::vector<size_t>& indices, int value)
+    {
+        if (!requested_)
+        {
+            throw std::runtime_error("GPIO output bank is not requested");
+        }
+        for (size_t index : indices)
+        {
+            values_.at(index) = value;
+        }
+        lines_->setValues(values_);
+    }
+
+private:
+    std::shared_ptr<IGpioBackend> backend_;
+    std::string chip_;
+    std::vector<unsigned int> offsets_;
+    std::unique_ptr<IGpioOutputs> lines_;
+    std::vector<int> values_;
+    std::mutex requestMutex_;
+    std::atomic<bool> requested_{false};
+};
+
+// Hands out the lines of one GPIO backend to every component of every
+// door, and groups line requests so that initialization takes one request
+// per group rather than one per line.
+class GpioChipRegistry
+{
+public:
+    static constexpr const char* kDefaultChip = "/dev/gpiochip0";
+
+    explicit GpioChipRegistry(std::shared_ptr<IGpioBackend> backend)
+        : backend_(std::move(backend))
+    {
+    }
+
+    // Request inputs that share one configuration in a single call
+    std::vector<std::unique_ptr<IGpioInput>> requestInputs(const std::vector<unsigned int>& offsets,
+        const IGpioBackend::InputConfig& config,
+        const std::string& chip = kDefaultChip)
+    {
+        return backend_->requestInputs(chip, offsets, config);
+    }
+
+    // The lines are only requested once the bank is
+    GpioOutputBank& outputs(const std::string& chip = kDefaultChip)
+    {
+        auto& bank = banks_[chip];
+        if (!bank)
+        {
+            bank = std::make_unique<GpioOutputBank>(backend_, chip);
+        }
+        return *bank;
+    }
+
+private:
+    std::shared_ptr<IGpioBackend> backend_;
+    std::map<std::string, std::unique_ptr<GpioOutputBank>> banks_;
+};
@@ -1,18 +1,45 @@
 #pragma once
-#include <gpiod.hpp>
+#include <chrono>
+#include <spdlog/spdlog.h>
 #include "../core/interfaces.hpp"
+#include "../core/event_loop.hpp"
+#include "../utils/payload_writer.hpp"
+#include "door_config.hpp"
+#include "gpio_chip_registry.hpp"
 
+// Edge-triggered input with contact debouncing and event-storm suppression.
+//
+// The libgpiod v1 backend has no kernel debounce, so edges are filtered
+// here on their timestamps: the first edge after a quiet period is acted on
+// at once, and edges within the debounce period after it are only counted.
+// Once the line has been quiet for the debounce period its level is sampled
+// again, so the state it settled at is always reported.
+//
+// A line that keeps toggling (a failing reed switch, a noisy proximity
+// sensor) is marked faulty after too many edges in one window: a single
+// fault event is raised and state changes are suppressed until a whole
+// window passes below the limit.
 class GpioSensor : public IDoorComponent, public IEventEmitter
 {
 public:
     GpioSensor(const std::string& doorId,
-        unsigned int pin,
-        bool activeHigh, 
-        const std::string& sensorType)
+        const SensorConfig& config,
+        const std::string& sensorType,
+        std::shared_ptr<EventLoop> loop,
+        std::shared_ptr<GpioChipRegistry> gpio,
+        PayloadFormat format = PayloadFormat::Json)
     : doorId_(doorId)
-    , pin_(pin)
-    , activeHigh_(activeHigh)
+    , config_(config)
     , sensorType_(sensorType)
+    , topic_("door/" + doorId + "/" + sensorType)
+    , faultTopic_(topic_ + "/fault")
+    , eventType_(sensorType + "_change")
+    , faultType_(sensorType + "_fault")
+    , format_(format)
+    , loop_(loop)
+    , gpio_(gpio)
+    , settleTimer_(loop->timers(), [this]() { onSettled(); })
+    , stormTimer_(loop->timers(), [this]() { onStormCheck(); })
     {
     }
 
@@ -20,26 +47,35 @@ public:
     {
         try
         {
-            chip_ = std::make_unique<gpiod::chip>("/dev/gpiochip0");
-            line_ = chip_->get_line(pin_);
-            line_.request({"door_sensor", gpiod::line_request::EVENT_BOTH_EDGES, gpiod::line_request::FLAG_BIAS_PULL_UP});
-            
-            running_ = true;
-            sensorThread_ = std::thread(&GpioSensor::monitorLoop, this);
+            line_ = std::move(gpio_->requestInputs({config_.pin}, {"door_sensor", IGpioBackend::Edges::Both, true})[0]);
+            currentState_ = readState();
+
+            eventFd_ = line_->eventFd();
+            if (!loop_->add(eventFd_, EPOLLIN, [this](uint32_t) { onLineEvent(); }))
+            {
+                spdlog::error("Sensor {} on door {} failed to initialize: could not register with event loop",
+                    sensorType_, doorId_);
+                releaseLine();
+                return false;
+            }
             return true;
         }
         catch (const std::exception& e)
         {
+            spdlog::error("Sensor {} on door {} failed to initialize: {}", sensorType_, doorId_, e.what());
+            releaseLine();
             return false;
         }
     }
 
     void cleanup() override
     {
-        running_ = false;
-        if (sensorThread_.joinable())
+        settleTimer_.cancel();
+        stormTimer_.cancel();
+        if (eventFd_ >= 0)
         {
-            sensorThread_.join();
+            loop_->remove(eventFd_);
+            eventFd_ = -1;
         }
     }
 
@@ -48,46 +84,184 @@ public:
         eventCallback = std::move(callback);
     }
 
+    // Called with the fault topic and message when the sensor is marked
+    // faulty or recovers
+    void registerFaultCallback(std::function<void(const std::string&, const std::string&)> callback)
+    {
+        faultCallback_ = std::move(callback);
+    }
+
     bool getState() const
     {
         return currentState_.load();
     }
 
+    bool faulty() const
+    {
+        return faulty_;
+    }
+
 private:
-    void monitorLoop()
+    // Give the line back after a failed initialize(), so that a retry can
+    // request it again
+    void releaseLine()
+    {
+        line_.reset();
+        eventFd_ = -1;
+    }
+
+    // Called from the event loop when the line's event fd is readable
+    void onLineEvent()
     {
-        while (running_.load())
+        GpioEdge edges[kEventBatch];
+        bool accepted = false;
+        int count;
+        do
         {
-            auto ev = line_.event_wait(std::chrono::milliseconds(100));
-            if (ev)
+            count = line_->readEdges(edges, kEventBatch);
+            for (int i = 0; i < count; i++)
             {
-                auto event = line_.event_read();
-                bool newState = (line_.get_value() == 1) == activeHigh_;
-                
-                if (newState != currentState_)
+                auto timestamp = edges[i].timestamp;
+                countEdge(timestamp);
+                if (lastAccepted_ == std::chrono::nanoseconds::zero() ||
+                    timestamp - lastAccepted_ >= config_.debounce)
                 {
-                    currentState_ = newState;
-                    if (eventCallback)
-                    {
-                        nlohmann::json event;
-                        event["type"] = sensorType_ + "_change";
-                        event["door_id"] = doorId_;
-                        event["state"] = currentState_.load();  // Get value from atomic
-                        event["timestamp"] = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-                        eventCallback("door/" + doorId_ + "/" + sensorType_, event.dump());
-                    }
+                    accepted = true;
+                    lastAccepted_ = timestamp;
                 }
             }
+        } while (count == kEventBatch);
+
+        if (faulty_)
+        {
+            return;
+        }
+        if (accepted)
+        {
+            sample();
+        }
+        if (config_.debounce.count() > 0)
+        {
+            settleTimer_.start(config_.debounce);
+        }
+    }
+
+    // The line has been quiet for a debounce period; report where it ended up
+    void onSettled()
+    {
+        if (!faulty_)
+        {
+            sample();
         }
     }
 
+    void sample()
+    {
+        bool newState = readState();
+        if (newState != currentState_)
+        {
+            currentState_ = newState;
+            if (eventCallback)
+            {
+                PayloadWriter(message_, format_)
+                    .field("type", eventType_)
+                    .field("door_id", doorId_)
+                    .field("state", newState)
+                    .field("timestamp", unixTime())
+                    .finish();
+                eventCallback(topic_, message_);
+            }
+        }
+    }
+
+    void countEdge(std::chrono::nanoseconds timestamp)
+    {
+        windowEdges_++;
+        if (!faulty_ && timestamp - windowStart_ >= config_.stormWindow)
+        {
+            windowStart_ = timestamp;
+            windowEdges_ = 1;
+        }
+
+        if (!faulty_ && config_.stormEdges > 0 && windowEdges_ > config_.stormEdges)
+        {
+            faulty_ = true;
+            settleTimer_.cancel();
+            spdlog::warn("Sensor {} on door {} is faulty: {} edges within {} ms, suppressing its events",
+                sensorType_, doorId_, windowEdges_, config_.stormWindow.count());
+            publishFault(windowEdges_);
+            windowEdges_ = 0;
+            stormTimer_.start(config_.stormWindow);
+        }
+    }
+
+    // While faulty, edges are counted per window until one comes in below the limit
+    void onStormCheck()
+    {
+        if (windowEdges_ > config_.stormEdges)
+        {
+            windowEdges_ = 0;
+            stormTimer_.start(config_.stormWindow);
+            return;
+        }
+
+        faulty_ = false;
+        windowEdges_ = 0;
+        windowStart_ = std::chrono::steady_clock::now().time_since_epoch();
+        spdlog::info("Sensor {} on door {} recovered", sensorType_, doorId_);
+        publishFault(0);
+        sample();
+    }
+
+    void publishFault(unsigned int edges)
+    {
+        if (!faultCallback_)
+        {
+            return;
+        }
+        PayloadWriter(message_, format_)
+            .field("type", faultType_)
+            .field("door_id", doorId_)
+            .field("faulty", faulty_)
+            .field("edges", edges)
+            .field("timestamp", unixTime())
+            .finish();
+        faultCallback_(faultTopic_, message_);
+    }
+
+    bool readState() const
+    {
+        return (line_->value() == 1) == config_.activeHigh;
+    }
+
+    static int64_t unixTime()
+    {
+        return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    }
+
+    static constexpr int kEventBatch = 16;
+
     std::string doorId_;
-    unsigned int pin_;
-    bool activeHigh_;
+    SensorConfig config_;
     std::string sensorType_;
-    std::unique_ptr<gpiod::chip> chip_;
-    gpiod::line line_;
-    std::atomic<bool> running_{false};
+    const std::string topic_;
+    const std::string faultTopic_;
+    const std::string eventType_;
+    const std::string faultType_;
+    const PayloadFormat format_;
+    std::string message_;  // Reused for every event
+    std::unique_ptr<IGpioInput> line_;
+    std::shared_ptr<EventLoop> loop_;
+    std::shared_ptr<GpioChipRegistry> gpio_;
+    int eventFd_{-1};
     std::atomic<bool> currentState_{false};
-    std::thread sensorThread_;
+    std::function<void(const std::string&, const std::string&)> faultCallback_;
+
+    // Event loop thread only
+    std::chrono::nanoseconds lastAccepted_{0};
+    std::chrono::nanoseconds windowStart_{0};
+    unsigned int windowEdges_{0};
+    bool faulty_{false};
+    TimerWheel::Timer settleTimer_;
+    TimerWheel::Timer stormTimer_;
 };
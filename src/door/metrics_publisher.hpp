@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include "../core/event_loop.hpp"
+#include "../mqtt/mqtt_client.hpp"
+#include "../utils/metrics.hpp"
+
+// Publishes a metrics snapshot every interval: each door's on
+// door/<id>/metrics and the process-wide ones (MQTT) on controller/metrics,
+// or on a topic of the process's own when there are several.
+// Snapshots are cumulative since startup, so a lost one costs nothing and
+// they go out at QoS 0.
+class MetricsPublisher
+{
+public:
+    MetricsPublisher(std::shared_ptr<MqttClient> mqtt,
+        std::shared_ptr<EventLoop> loop,
+        const std::string& controllerTopic = kControllerTopic,
+        std::chrono::milliseconds interval = std::chrono::seconds(10))
+        : mqtt_(mqtt)
+        , loop_(loop)
+        , controllerTopic_(controllerTopic)
+        , interval_(interval)
+        , timer_(loop->timers(), [this]() { publish(); })
+    {
+        // Timers belong to the loop thread
+        loop_->runInLoop([this]() { timer_.start(interval_); });
+    }
+
+    MetricsPublisher(const MetricsPublisher&) = delete;
+    MetricsPublisher& operator=(const MetricsPublisher&) = delete;
+
+private:
+    void publish()
+    {
+        for (const auto& door : Metrics::doors())
+        {
+            mqtt_->publish("door/" + door + "/metrics", Metrics::writeJson(door, buffer_));
+        }
+        mqtt_->publish(controllerTopic_, Metrics::writeJson("", buffer_));
+        timer_.start(interval_);
+    }
+
+    static constexpr const char* kControllerTopic = "controller/metrics";
+
+    std::shared_ptr<MqttClient> mqtt_;
+    std::shared_ptr<EventLoop> loop_;
+    std::string controllerTopic_;
+    std::chrono::milliseconds interval_;
+    std::string buffer_;
+    TimerWheel::Timer timer_;
+};
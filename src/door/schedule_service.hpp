@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include "../access/access_policy.hpp"
+#include "../mqtt/mqtt_client.hpp"
+
+// Replaces access schedules at runtime. Request on schedules/set:
+//   {"name": "business_hours",
+//    "weekly": [{"days": ["mon", "fri"], "from": "08:00", "to": "18:00"}],
+//    "holidays": ["2026-12-25"]}
+// Only that schedule and the doors using it are recompiled. Doors can only
+// use schedules named in the configuration file, but any of those can be
+// changed here.
+class ScheduleService
+{
+public:
+    ScheduleService(std::shared_ptr<MqttClient> mqtt, std::shared_ptr<AccessPolicy> policy)
+        : mqtt_(mqtt)
+        , policy_(policy)
+    {
+        // AccessPolicy is thread-safe, so this runs on whichever thread
+        // services MQTT
+        subscription_ = mqtt_->subscribe(kSetTopic, [this](std::string_view, std::string_view payload)
+        {
+            handleSet(payload);
+        });
+    }
+
+    ~ScheduleService()
+    {
+        mqtt_->unsubscribe(subscription_);
+    }
+
+    ScheduleService(const ScheduleService&) = delete;
+    ScheduleService& operator=(const ScheduleService&) = delete;
+
+private:
+    void handleSet(std::string_view payload)
+    {
+        try
+        {
+            nlohmann::json request = nlohmann::json::parse(payload);
+            std::string name = request.at("name").get<std::string>();
+            request.erase("name");
+            policy_->setSchedule(name, parseWeeklySchedule(request));
+            spdlog::info("Access schedule {} updated", name);
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Bad schedule update: {}", e.what());
+        }
+    }
+
+    static constexpr const char* kSetTopic = "schedules/set";
+
+    std::shared_ptr<MqttClient> mqtt_;
+    std::shared_ptr<AccessPolicy> policy_;
+    MqttClient::SubscriptionId subscription_;
+};
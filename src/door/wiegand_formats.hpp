@@ -0,0 +1,186 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "wiegand_frame.hpp"
+
+// Decoded card data from a complete frame
+struct WiegandCard
+{
+    uint64_t raw{0};
+    uint8_t length{0};
+    const char* format{""};
+    uint32_t facilityCode{0};
+    uint64_t cardNumber{0};
+    bool evenParityOk{false};
+    bool oddParityOk{false};
+
+    bool parityValid() const { return evenParityOk && oddParityOk; }
+};
+
+// Layout of one Wiegand format. Every position is a frame bit index (0 = first
+// bit clocked out) and every count a number of bits, all known at compile
+// time, so decode() reduces to a handful of constant shifts, masks and popcounts.
+//
+// Parity ranges include the parity bit itself: the even range must hold an
+// even number of ones, the odd range an odd number.
+template <unsigned Length,
+    unsigned EvenFirst, unsigned EvenCount,
+    unsigned OddFirst, unsigned OddCount,
+    unsigned FacilityFirst, unsigned FacilityCount,
+    unsigned NumberFirst, unsigned NumberCount>
+struct WiegandFormat
+{
+    static_assert(Length > 0 && Length <= WiegandFrame::kMaxBits, "Frame length out of range");
+    static_assert(EvenFirst + EvenCount <= Length && OddFirst + OddCount <= Length, "Parity range outside frame");
+    static_assert(FacilityFirst + FacilityCount <= Length && NumberFirst + NumberCount <= Length, "Field outside frame");
+    static_assert(FacilityCount <= 32, "Facility code must fit in 32 bits");
+
+    static constexpr unsigned kLength = Length;
+
+    static WiegandCard decode(const WiegandFrame& frame)
+    {
+        WiegandCard card;
+        card.raw = frame.bits;
+        card.length = Length;
+        card.evenParityOk = __builtin_popcountll(field<EvenFirst, EvenCount>(frame.bits)) % 2 == 0;
+        card.oddParityOk = __builtin_popcountll(field<OddFirst, OddCount>(frame.bits)) % 2 == 1;
+        card.facilityCode = static_cast<uint32_t>(field<FacilityFirst, FacilityCount>(frame.bits));
+        card.cardNumber = field<NumberFirst, NumberCount>(frame.bits);
+        return card;
+    }
+
+    // Frame bits for a card with both parity bits set to match; the inverse
+    // of decode(). The even parity bit leads its range, the odd one ends it.
+    static uint64_t encode(uint32_t facilityCode, uint64_t cardNumber)
+    {
+        uint64_t bits = place<FacilityFirst, FacilityCount>(facilityCode) | place<NumberFirst, NumberCount>(cardNumber);
+        if (__builtin_popcountll(field<EvenFirst, EvenCount>(bits)) % 2 != 0)
+        {
+            bits |= place<EvenFirst, 1>(1);
+        }
+        if (__builtin_popcountll(field<OddFirst, OddCount>(bits)) % 2 == 0)
+        {
+            bits |= place<OddFirst + OddCount - 1, 1>(1);
+        }
+        return bits;
+    }
+
+private:
+    template <unsigned First, unsigned Count>
+    static constexpr uint64_t place(uint64_t value)
+    {
+        if constexpr (Count == 0)
+        {
+            return 0;
+        }
+        else
+        {
+            return (value & WiegandFrame::lowMask(Count)) << (Length - First - Count);
+        }
+    }
+
+    template <unsigned First, unsigned Count>
+    static constexpr uint64_t field(uint64_t bits)
+    {
+        if constexpr (Count == 0)
+        {
+            return 0;
+        }
+        else
+        {
+            return (bits >> (Length - First - Count)) & WiegandFrame::lowMask(Count);
+        }
+    }
+};
+
+// HID H10301 standard 26-bit
+struct Wiegand26 : WiegandFormat<26, 0, 13, 13, 13, 1, 8, 9, 16>
+{
+    static constexpr const char* kName = "H10301";
+};
+
+// Site 32-bit layout used by the original readers
+struct Wiegand32 : WiegandFormat<32, 0, 16, 16, 16, 1, 8, 9, 16>
+{
+    static constexpr const char* kName = "W32";
+};
+
+// HID H10306 34-bit
+struct Wiegand34 : WiegandFormat<34, 0, 17, 17, 17, 1, 16, 17, 16>
+{
+    static constexpr const char* kName = "H10306";
+};
+
+// HID H10302 37-bit, 35-bit card number and no facility code
+struct Wiegand37 : WiegandFormat<37, 0, 19, 18, 19, 0, 0, 1, 35>
+{
+    static constexpr const char* kName = "H10302";
+};
+
+// Maps frame length straight to the matching format's decoder through a
+// table built at compile time, so dispatch is a single indexed load.
+template <typename... Formats>
+class WiegandFormatRegistry
+{
+public:
+    using DecodeFn = WiegandCard (*)(const WiegandFrame&);
+
+    // Returns false for overflowed frames and lengths with no registered format
+    static bool decode(const WiegandFrame& frame, WiegandCard& card)
+    {
+        if (frame.overflow)
+        {
+            return false;
+        }
+        DecodeFn fn = kTable[frame.length];
+        if (!fn)
+        {
+            return false;
+        }
+        card = fn(frame);
+        return true;
+    }
+
+    static constexpr bool supports(unsigned length)
+    {
+        return length <= WiegandFrame::kMaxBits && kTable[length] != nullptr;
+    }
+
+private:
+    template <typename Format>
+    static WiegandCard decodeAs(const WiegandFrame& frame)
+    {
+        WiegandCard card = Format::decode(frame);
+        card.format = Format::kName;
+        return card;
+    }
+
+    static constexpr std::array<DecodeFn, WiegandFrame::kMaxBits + 1> makeTable()
+    {
+        std::array<DecodeFn, WiegandFrame::kMaxBits + 1> table{};
+        ((table[Formats::kLength] = &decodeAs<Formats>), ...);
+        return table;
+    }
+
+    static constexpr bool lengthsUnique()
+    {
+        constexpr unsigned lengths[] = {Formats::kLength...};
+        for (size_t i = 0; i < sizeof...(Formats); i++)
+        {
+            for (size_t j = i + 1; j < sizeof...(Formats); j++)
+            {
+                if (lengths[i] == lengths[j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static_assert(lengthsUnique(), "Only one format can be registered per frame length");
+
+    static constexpr std::array<DecodeFn, WiegandFrame::kMaxBits + 1> kTable = makeTable();
+};
+
+using WiegandFormats = WiegandFormatRegistry<Wiegand26, Wiegand32, Wiegand34, Wiegand37>;
@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+// Fixed-size accumulator for one Wiegand frame. Bits are held MSB first in a
+// 64-bit shift register, so the first bit clocked out by the reader ends up
+// as the most significant bit of a `length`-bit value.
+struct WiegandFrame
+{
+    static constexpr uint8_t kMaxBits = 64;
+
+    uint64_t bits{0};
+    uint8_t length{0};
+    bool overflow{false};  // More bits arrived than the register can hold
+
+    bool empty() const { return length == 0 && !overflow; }
+
+    void clear()
+    {
+        bits = 0;
+        length = 0;
+        overflow = false;
+    }
+
+    void push(int bit)
+    {
+        insert(length, bit);
+    }
+
+    // Insert a bit so it becomes bit number `pos` of the frame (0 = first).
+    // Used when an edge turns out to be older than ones already accumulated.
+    void insert(uint8_t pos, int bit)
+    {
+        if (length >= kMaxBits)
+        {
+            overflow = true;
+            return;
+        }
+
+        unsigned below = length - pos;  // Bits that stay where they are
+        uint64_t low = bits & lowMask(below);
+        uint64_t high = below >= 64 ? 0 : bits >> below;
+        uint64_t shiftedHigh = below + 1 >= 64 ? 0 : high << (below + 1);
+        bits = shiftedHigh | (static_cast<uint64_t>(bit & 1) << below) | low;
+        length++;
+    }
+
+    // Value of `count` bits starting at frame bit `first` (0 = first bit).
+    uint64_t field(unsigned first, unsigned count) const
+    {
+        return (bits >> (length - first - count)) & lowMask(count);
+    }
+
+    static constexpr uint64_t lowMask(unsigned count)
+    {
+        return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+    }
+};
+
+// "0x" followed by one zero-padded hex digit per nibble of the frame
+using WiegandHexString = std::array<char, 2 + WiegandFrame::kMaxBits / 4 + 1>;
+
+// One '0'/'1' character per frame bit
+using WiegandBitString = std::array<char, WiegandFrame::kMaxBits + 1>;
+
+inline std::string_view formatWiegandHex(uint64_t raw, uint8_t length, WiegandHexString& out)
+{
+    unsigned digits = (length + 3) / 4;
+    if (digits == 0)
+    {
+        digits = 1;
+    }
+
+    char* begin = out.data() + 2;
+    char* end = begin + digits;
+    out[0] = '0';
+    out[1] = 'x';
+
+    // to_chars writes the minimal number of digits; right-align and zero-pad
+    char scratch[16];
+    auto result = std::to_chars(scratch, scratch + sizeof(scratch), raw, 16);
+    size_t written = result.ptr - scratch;
+    size_t pad = digits > written ? digits - written : 0;
+    std::fill(begin, begin + pad, '0');
+    std::copy(result.ptr - (digits - pad), result.ptr, begin + pad);
+    *end = '\0';
+    return std::string_view(out.data(), end - out.data());
+}
+
+inline std::string_view formatWiegandBits(const WiegandFrame& frame, WiegandBitString& out)
+{
+    for (unsigned i = 0; i < frame.length; i++)
+    {
+        out[i] = ((frame.bits >> (frame.length - 1 - i)) & 1) ? '1' : '0';
+    }
+    out[frame.length] = '\0';
+    return std::string_view(out.data(), frame.length);
+}
@@ -1,25 +1,43 @@
 #pragma once
-#include <gpiod.hpp>
 #include "../core/interfaces.hpp"
 #include "../core/door_types.hpp"
+#include "../core/event_loop.hpp"
+#include "wiegand_frame.hpp"
+#include "wiegand_formats.hpp"
+#include "gpio_chip_registry.hpp"
+#include "../utils/metrics.hpp"
+#include <sys/timerfd.h>
 #include <chrono>
-#include <thread>
 #include <spdlog/spdlog.h>
-#include <nlohmann/json.hpp>
 #include <algorithm>
-#include <numeric>
-#include <sstream>
-#include <iomanip>
 
-class WiegandReader : public IDoorComponent, public IEventEmitter
+// Card read as delivered to the door, straight from the decoder
+struct CardReadEvent
+{
+    uint64_t value;
+    uint8_t bitLength;
+    const char* format;
+    uint32_t facilityCode;
+    uint64_t cardNumber;
+    bool parityValid;
+    std::chrono::system_clock::time_point timestamp;
+    std::chrono::steady_clock::time_point lastEdge;  // Kernel timestamp of the frame's last edge
+};
+
+class WiegandReader : public IDoorComponent, public ITypedEventEmitter<CardReadEvent>
 {
 public:
     WiegandReader(const std::string& doorId,
         unsigned int data0Pin,
-        unsigned int data1Pin)
+        unsigned int data1Pin,
+        std::shared_ptr<EventLoop> loop,
+        std::shared_ptr<GpioChipRegistry> gpio)
     : doorId_(doorId)
     , data0Pin_(data0Pin)
     , data1Pin_(data1Pin)
+    , loop_(loop)
+    , gpio_(gpio)
+    , frameLatency_(Metrics::histogram("wiegand_frame_ns", doorId))
     {
     }
 
@@ -27,189 +45,242 @@ public:
     {
         try
         {
-            chip_ = std::make_unique<gpiod::chip>("/dev/gpiochip0");
-            d0_ = chip_->get_line(data0Pin_);
-            d1_ = chip_->get_line(data1Pin_);
+            // Configure GPIO for Wiegand reader - bits are clocked out on the
+            // falling edge, so rising edges are never queued by the kernel.
+            // Both data lines go out in one request.
+            auto lines = gpio_->requestInputs({data0Pin_, data1Pin_},
+                {"door_reader", IGpioBackend::Edges::Falling, true});
+            d0_ = std::move(lines[0]);
+            d1_ = std::move(lines[1]);
 
-            // Configure GPIO for Wiegand reader
-            gpiod::line_request config
-            {
-                .consumer = "door_reader",
-                .request_type = gpiod::line_request::EVENT_BOTH_EDGES,
-                .flags = gpiod::line_request::FLAG_BIAS_PULL_UP
-            };
+            spdlog::info("Wiegand reader initialized on D0={} D1={}", data0Pin_, data1Pin_);
 
-            d0_.request(config);
-            d1_.request(config);
+            // One-shot timer that fires once the line has been idle for a full
+            // inter-frame gap, marking the end of the current frame
+            frameTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (frameTimerFd_ < 0)
+            {
+                spdlog::error("Reader initialization failed: could not create frame timer");
+                releaseLines();
+                return false;
+            }
 
-            spdlog::info("Wiegand reader initialized on D0={} D1={}", data0Pin_, data1Pin_);
+            d0Fd_ = d0_->eventFd();
+            d1Fd_ = d1_->eventFd();
+            if (!loop_->add(d0Fd_, EPOLLIN, [this](uint32_t) { onDataReady(); }) ||
+                !loop_->add(d1Fd_, EPOLLIN, [this](uint32_t) { onDataReady(); }) ||
+                !loop_->add(frameTimerFd_, EPOLLIN, [this](uint32_t) { onFrameTimeout(); }))
+            {
+                spdlog::error("Reader initialization failed: could not register with event loop");
+                cleanup();
+                releaseLines();
+                return false;
+            }
 
-            running_ = true;
-            readerThread_ = std::thread(&WiegandReader::readerLoop, this);
-            spdlog::info("Reader thread started successfully");
+            spdlog::info("Reader registered with event loop");
             return true;
         }
         catch (const std::exception& e)
         {
             spdlog::error("Reader initialization failed: {}", e.what());
+            cleanup();
+            releaseLines();
             return false;
         }
     }
 
     void cleanup() override
     {
-        running_ = false;
-        if (readerThread_.joinable())
+        for (int* fd : {&d0Fd_, &d1Fd_})
         {
-            readerThread_.join();
+            if (*fd >= 0)
+            {
+                loop_->remove(*fd);
+                *fd = -1;
+            }
+        }
+        if (frameTimerFd_ >= 0)
+        {
+            loop_->remove(frameTimerFd_);
+            close(frameTimerFd_);
+            frameTimerFd_ = -1;
         }
     }
 
-    void registerCallback(std::function<void(const std::string&, const std::string&)> callback) override
+    void registerCallback(std::function<void(const CardReadEvent&)> callback) override
     {
         eventCallback = std::move(callback);
     }
 
 private:
-    void readerLoop()
+    // Give the data lines back after a failed initialize(), so that a retry
+    // can request them again instead of failing with EBUSY
+    void releaseLines()
     {
-        std::vector<int> bits;
-        auto lastEvent = std::chrono::steady_clock::now();
-        const auto timeout = std::chrono::milliseconds(50);  // Standard Wiegand timing
-        bool collecting = false;
-
-        spdlog::info("Reader started on D0={} D1={}", data0Pin_, data1Pin_);
-        
-        while (running_.load())
+        d0_.reset();
+        d1_.reset();
+    }
+
+    // Called from the event loop when D0 or D1 has queued edges
+    void onDataReady()
+    {
+        drainEdges();
+        armFrameTimer(kFrameGap);
+    }
+
+    // Called from the event loop once no edge has arrived for a full frame gap
+    void onFrameTimeout()
+    {
+        uint64_t expirations;
+        if (read(frameTimerFd_, &expirations, sizeof(expirations)) < 0)
         {
-            auto now = std::chrono::steady_clock::now();
-            
-            // Wait for events on both lines
-            auto ev_d0 = d0_.event_wait(std::chrono::microseconds(100));
-            auto ev_d1 = d1_.event_wait(std::chrono::microseconds(100));
-            
-            if (ev_d0)
-            {
-                auto event = d0_.event_read();
-                if (event.event_type == gpiod::line_event::FALLING_EDGE)
-                {
-                    if (!collecting)
-                    {
-                        bits.clear();
-                        collecting = true;
-                    }
-                    bits.push_back(0);
-                    lastEvent = now;
-                }
-            }
-            
-            if (ev_d1)
-            {
-                auto event = d1_.event_read();
-                if (event.event_type == gpiod::line_event::FALLING_EDGE)
-                {
-                    if (!collecting)
-                    {
-                        bits.clear();
-                        collecting = true;
-                    }
-                    bits.push_back(1);
-                    lastEvent = now;
-                }
-            }
+            return;
+        }
 
-            // Process collected bits after timeout
-            if (collecting && now - lastEvent > timeout)
+        // Pick up anything the kernel queued since the last batch, then decide
+        // on the edge timestamps whether the line has really been idle. Edge
+        // timestamps are on the steady_clock timeline.
+        drainEdges();
+        if (frame_.empty())
+        {
+            return;
+        }
+
+        auto idle = std::chrono::steady_clock::now().time_since_epoch() - lastEdge_;
+        if (idle < kFrameGap)
+        {
+            armFrameTimer(std::chrono::duration_cast<std::chrono::nanoseconds>(kFrameGap - idle));
+            return;
+        }
+        completeFrame();
+    }
+
+    // Read every queued edge from both lines and merge them by timestamp.
+    // Batches land in stack buffers, not vectors.
+    void drainEdges()
+    {
+        GpioEdge d0Events[kEventBatch];
+        GpioEdge d1Events[kEventBatch];
+        int d0Count, d1Count;
+        do
+        {
+            d0Count = d0_->readEdges(d0Events, kEventBatch);
+            d1Count = d1_->readEdges(d1Events, kEventBatch);
+
+            // Each line's queue is already in timestamp order
+            int i = 0, j = 0;
+            while (i < d0Count || j < d1Count)
             {
-                if (bits.size() == 32)
+                bool takeD0 = j >= d1Count ||
+                    (i < d0Count && d0Events[i].timestamp <= d1Events[j].timestamp);
+                const GpioEdge& edge = takeD0 ? d0Events[i++] : d1Events[j++];
+                if (!edge.rising)
                 {
-                    processCard(bits);
+                    addEdge(edge.timestamp, takeD0 ? 0 : 1);
                 }
-                bits.clear();
-                collecting = false;
             }
-            
-            // Prevent busy waiting
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-        }
+        } while (d0Count == kEventBatch || d1Count == kEventBatch);
     }
 
-    void processCard(const std::vector<int>& bits)
+    void addEdge(std::chrono::nanoseconds timestamp, int bit)
     {
-        // Calculate parity bits and validate
-        bool evenParity = bits[0];
-        bool oddParity = bits[31];
-        int evenCount = std::count_if(bits.begin(), bits.begin() + 16, [](int b) { return b == 1; });
-        int oddCount = std::count_if(bits.begin() + 16, bits.end(), [](int b) { return b == 1; });
-        bool parityValid = (evenCount % 2 == 0) && (oddCount % 2 == 1);
-
-        // Extract card data
-        uint16_t facilityCode = 0;
-        for (int i = 1; i < 9; i++)
+        // A gap between edges longer than the inter-frame time means the
+        // previous frame is over, even if its timer hasn't fired yet
+        if (!frame_.empty() && timestamp - lastEdge_ > kFrameGap)
         {
-            facilityCode = (facilityCode << 1) | bits[i];
+            completeFrame();
         }
 
-        uint32_t cardNumber = 0;
-        for (int i = 9; i < 25; i++)
+        if (frame_.length == WiegandFrame::kMaxBits)
         {
-            cardNumber = (cardNumber << 1) | bits[i];
+            frame_.overflow = true;
         }
+        else
+        {
+            // An edge read in a later batch can still be older than the newest
+            // one we have, so insert by timestamp rather than append
+            auto first = edgeTimes_.begin();
+            auto last = first + frame_.length;
+            auto pos = std::upper_bound(first, last, timestamp);
+            std::move_backward(pos, last, last + 1);
+            *pos = timestamp;
+            frame_.insert(static_cast<uint8_t>(pos - first), bit);
+        }
+        lastEdge_ = std::max(lastEdge_, timestamp);
+    }
+
+    void completeFrame()
+    {
+        // Time from the last edge includes the inter-frame gap we waited out
+        auto lastEdge = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(lastEdge_));
+        frameLatency_.recordSince(lastEdge);
+
+        WiegandCard card;
+        if (WiegandFormats::decode(frame_, card))
+        {
+            processCard(frame_, card, lastEdge);
+        }
+        else
+        {
+            SPDLOG_DEBUG("Ignoring {}-bit frame on door {}: no matching Wiegand format",
+                frame_.length, doorId_);
+        }
+        frame_.clear();
+        lastEdge_ = std::chrono::nanoseconds::zero();
+    }
+
+    void armFrameTimer(std::chrono::nanoseconds delay)
+    {
+        itimerspec spec{};
+        spec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(delay).count();
+        spec.it_value.tv_nsec = (delay % std::chrono::seconds(1)).count();
+        timerfd_settime(frameTimerFd_, 0, &spec, nullptr);
+    }
+
+    void processCard([[maybe_unused]] const WiegandFrame& frame, const WiegandCard& card,
+        std::chrono::steady_clock::time_point lastEdge)
+    {
+        // The access decision is logged once by the door; the raw bit dump is
+        // only compiled into trace builds
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+        WiegandBitString bitBuf;
+        SPDLOG_TRACE("Door {} frame: bits={} length={} format={} parity even={} odd={}",
+            doorId_, formatWiegandBits(frame, bitBuf), card.length, card.format,
+            card.evenParityOk, card.oddParityOk);
+#endif
 
-        uint32_t fullValue = std::accumulate(bits.begin(), bits.end(), 0u, 
-            [](uint32_t acc, int bit) { return (acc << 1) | bit; });
-
-        // Convert bits to string for logging
-        std::string bitStr;
-        for (int b : bits) bitStr += std::to_string(b);
-
-        // Format hex value
-        std::stringstream hexValue;
-        hexValue << "0x" << std::hex << std::setfill('0') << std::setw(8) << fullValue;
-
-        // Log all card details in one structured message
-        spdlog::info("\nReceived bits: {} (Length: {})\n"
-                    "Card Details:\n"
-                    "  Full Hex: {}\n"
-                    "  Full Dec: {}\n"
-                    "  Facility Code: {}\n"
-                    "  Card Number: {}\n"
-                    "  Parity: {} (Even:{} Odd:{})\n",
-                    bitStr, bits.size(),
-                    hexValue.str(),
-                    fullValue,
-                    facilityCode,
-                    cardNumber,
-                    parityValid ? "Valid" : "Invalid", 
-                    evenCount % 2 == 0, oddCount % 2 == 1);
-
-        // Emit MQTT event
         if (eventCallback)
         {
-            nlohmann::json event = nlohmann::json
+            eventCallback(CardReadEvent
             {
-                {"event", "access_attempt"},
-                {"door_id", doorId_},
-                {"card", nlohmann::json{
-                    {"raw", hexValue.str()},
-                    {"facility_code", facilityCode},
-                    {"number", cardNumber}
-                }},
-                {"access", nlohmann::json{
-                    {"granted", fullValue == 0x9d3b9f40},
-                    {"parity_valid", parityValid}
-                }},
-                {"timestamp", std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())}
-            };
-            eventCallback("access/" + doorId_, event.dump());
+                card.raw,
+                card.length,
+                card.format,
+                card.facilityCode,
+                card.cardNumber,
+                card.parityValid(),
+                std::chrono::system_clock::now(),
+                lastEdge
+            });
         }
     }
 
     std::string doorId_;
     unsigned int data0Pin_, data1Pin_;
-    std::unique_ptr<gpiod::chip> chip_;
-    gpiod::line d0_, d1_;
-    std::atomic<bool> running_{false};
-    std::thread readerThread_;
-    std::function<void(const std::string&, const std::string&)> eventCallback;
+    std::unique_ptr<IGpioInput> d0_, d1_;
+    std::shared_ptr<EventLoop> loop_;
+    std::shared_ptr<GpioChipRegistry> gpio_;
+    int d0Fd_{-1};
+    int d1Fd_{-1};
+    int frameTimerFd_{-1};
+    WiegandFrame frame_;
+    std::array<std::chrono::nanoseconds, WiegandFrame::kMaxBits> edgeTimes_{};
+    std::chrono::nanoseconds lastEdge_{0};
+    LatencyHistogram& frameLatency_;
+
+    static constexpr int kEventBatch = 16;
+
+    // Standard Wiegand timing, measured between kernel edge timestamps
+    static constexpr std::chrono::nanoseconds kFrameGap{std::chrono::milliseconds(50)};
 };
@@ -1,90 +1,414 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <cstdlib>
 #include <vector>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include "core/cancellation_token.hpp"
+#include "core/event_loop.hpp"
+#include "core/libgpiod_backend.hpp"
+#include "core/realtime.hpp"
+#include "core/supervisor.hpp"
+#include "core/worker_pool.hpp"
 #include "door/door.hpp"
 #include "mqtt/mqtt_client.hpp"
 #include "utils/logger.hpp"
+#include "access/credential_store.hpp"
+#include "access/audit_journal.hpp"
+#include "door/audit_service.hpp"
+#include "door/credential_sync.hpp"
+#include "door/controller_config.hpp"
+#include "door/door_startup.hpp"
+#include "door/schedule_service.hpp"
+#include "door/metrics_publisher.hpp"
+#include "utils/prometheus_endpoint.hpp"
 
-std::atomic<bool> running(true);
+const char* CONTROLLER_ID = "door_controller";
+const char* DEFAULT_CONFIG_PATH = "config/doors.json";
+const char* DEFAULT_CREDENTIALS_PATH = "config/credentials.json";
+const char* DEFAULT_JOURNAL_DIRECTORY = "journal";
 
-void signalHandler(int signal)
+int main(int argc, char** argv)
 {
-    if (signal == SIGINT || signal == SIGTERM)
+    // SIGINT/SIGTERM are delivered through a signalfd on the event loop. Block
+    // them before any thread is started so every thread inherits the mask.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    // Usage: door_controller [--config FILE] [--mqtt-thread] [--metrics-port PORT] [--workers N]
+    //                        [--realtime [--rt-priority N] [--rt-cpu N]] [--processes N]
+    //                        [credentials file]
+    std::string configPath = DEFAULT_CONFIG_PATH;
+    std::string credentialsPath = DEFAULT_CREDENTIALS_PATH;
+    bool mqttNetworkThread = false;
+    int metricsPort = 0;
+    int workerShards = 0;
+    bool realtime = false;
+    RealtimeOptions realtimeOptions;
+    unsigned processes = 0;
+    unsigned partition = 0;
+    unsigned partitions = 0;   // Set in a worker process started by the supervisor
+    for (int i = 1; i < argc; i++)
     {
-        running.store(false);
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc)
+        {
+            configPath = argv[++i];
+        }
+        else if (arg == "--mqtt-thread")
+        {
+            mqttNetworkThread = true;
+        }
+        else if (arg == "--metrics-port" && i + 1 < argc)
+        {
+            metricsPort = std::atoi(argv[++i]);
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            workerShards = std::atoi(argv[++i]);
+        }
+        else if (arg == "--realtime")
+        {
+            realtime = true;
+        }
+        else if (arg == "--rt-priority" && i + 1 < argc)
+        {
+            realtimeOptions.priority = std::atoi(argv[++i]);
+        }
+        else if (arg == "--rt-cpu" && i + 1 < argc)
+        {
+            realtimeOptions.cpu = std::atoi(argv[++i]);
+        }
+        else if (arg == "--processes" && i + 1 < argc)
+        {
+            processes = static_cast<unsigned>(std::max(std::atoi(argv[++i]), 0));
+        }
+        else if (arg == "--partition" && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%u/%u", &partition, &partitions) != 2 || partition >= partitions)
+            {
+                std::cerr << "--partition expects K/N with K < N" << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            credentialsPath = arg;
+        }
     }
-}
 
-int main(int argc, char** argv)
-{
-    // Setup signal handling
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    // Real-time mode reserves one core for one event loop, so it has no
+    // place for a set of worker processes
+    bool supervise = processes > 1 && partitions == 0;
+    if (supervise && realtime)
+    {
+        std::cerr << "--realtime can't be combined with --processes" << std::endl;
+        return 1;
+    }
+    if (supervise)
+    {
+        sigset_t childSignals;
+        sigemptyset(&childSignals);
+        sigaddset(&childSignals, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &childSignals, nullptr);
+    }
+
+    // Real-time mode keeps its core free of every other thread, so the core
+    // is reserved before the first one (the logger's) starts, and MQTT gets
+    // its own thread rather than sharing the FIFO event loop
+    std::unique_ptr<RealtimeMode> realtimeMode;
+    if (realtime)
+    {
+        try
+        {
+            realtimeMode = std::make_unique<RealtimeMode>(realtimeOptions);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        realtimeMode->reserveCpu();
+        mqttNetworkThread = true;
+    }
+
+    // Worker shards publish, which only the network thread mode allows
+    if (workerShards > 0)
+    {
+        mqttNetworkThread = true;
+    }
 
     // Initialize global logger
-    auto logger = spdlog::stdout_color_mt("console");
-    spdlog::set_default_logger(logger);
+    auto logger = Logger::initializeGlobal();
     logger->info("Door Control System Starting...");
 
+    // With --processes this process only supervises. Each worker process is
+    // started with the same command line, less --processes, plus its
+    // partition, and runs the controller for its doors alone.
+    if (supervise)
+    {
+        int supervisorExitCode = 1;
+        try
+        {
+            ControllerConfig config = ControllerConfigParser::loadFile(configPath);
+            auto assigned = partitionDoors(config.doors, processes);
+            unsigned used = *std::max_element(assigned.begin(), assigned.end()) + 1;
+            if (used < processes)
+            {
+                logger->warn("Only {} groups of doors to share out, starting {} worker processes", used, used);
+            }
+
+            std::vector<std::string> workerArgs;
+            for (int i = 0; i < argc; i++)
+            {
+                if (std::string(argv[i]) == "--processes" && i + 1 < argc)
+                {
+                    i++;
+                    continue;
+                }
+                workerArgs.push_back(argv[i]);
+            }
+            Supervisor supervisor(workerArgs, used);
+            supervisorExitCode = supervisor.run();
+        }
+        catch (const std::exception& e)
+        {
+            logger->error("Fatal error: {}", e.what());
+        }
+        Logger::shutdown();
+        return supervisorExitCode;
+    }
+
+    // Declared outside the try block so that however the run ends, an
+    // exception included, the doors still get their final lock pulse
+    auto shutdown = std::make_shared<CancellationToken>();
+    std::shared_ptr<WorkerPool> workers;
+    std::vector<std::unique_ptr<Door>> doors;
+    std::unique_ptr<DoorStartup> startup;
+    int exitCode = 0;
+
     try
     {
+        // A bad configuration is fatal; better not to start than to run
+        // doors on the wrong pins
+        ControllerConfig config = ControllerConfigParser::loadFile(configPath);
+        logger->info("Loaded {} doors from {}", config.doors.size(), configPath);
+
+        // A worker process keeps only its partition's doors, and has its own
+        // broker connection, journal, metrics topic and scrape port
+        std::string controllerId = CONTROLLER_ID;
+        std::string journalDirectory = DEFAULT_JOURNAL_DIRECTORY;
+        std::string metricsTopic = "controller/metrics";
+        if (partitions > 0)
+        {
+            auto assigned = partitionDoors(config.doors, partitions);
+            std::vector<DoorConfig> partitionDoorConfigs;
+            for (size_t i = 0; i < config.doors.size(); i++)
+            {
+                if (assigned[i] == partition)
+                {
+                    partitionDoorConfigs.push_back(config.doors[i]);
+                }
+            }
+            config.doors = std::move(partitionDoorConfigs);
+            controllerId += "-" + std::to_string(partition);
+            journalDirectory += "/" + std::to_string(partition);
+            metricsTopic = "controller/" + controllerId + "/metrics";
+            if (metricsPort > 0)
+            {
+                metricsPort += static_cast<int>(partition);
+            }
+            logger->info("Worker process {} of {}: serving {} doors", partition, partitions, config.doors.size());
+        }
+
         // Initialize MQTT client
-        auto mqtt = std::make_shared<MqttClient>("door_controller");
+        auto mqtt = std::make_shared<MqttClient>(controllerId);
+        if (config.payloadFormat != PayloadFormat::Json && !mqtt->enableContentTypes())
+        {
+            logger->warn("Cannot switch MQTT to v5, binary payloads go out without a content type");
+        }
         if (!mqtt->connect())
         {
-            logger->error("Failed to connect to MQTT broker");
-            return 1;
+            // Reconnects are retried in the background; events queue up until then
+            logger->warn("MQTT broker unreachable, starting offline");
         }
 
-        // Configure doors
-        std::vector<DoorConfig> doorConfigs =
+        // Single event loop shared by the GPIO lines of every door, the MQTT
+        // socket and all timers
+        auto eventLoop = std::make_shared<EventLoop>();
+
+        // A stop signal, or a startup failure under the exit policy, cancels
+        // the shutdown token, and the loop stops as soon as it is cancelled
+        int signalFd = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+        eventLoop->add(signalFd, EPOLLIN, [&](uint32_t)
         {
+            signalfd_siginfo info;
+            while (read(signalFd, &info, sizeof(info)) > 0) {}
+            logger->info("Stop signal received");
+            shutdown->cancel();
+        });
+        eventLoop->add(shutdown->fd(), EPOLLIN, [&](uint32_t) { eventLoop->stop(); });
+
+        if (mqttNetworkThread)
+        {
+            if (!mqtt->startNetworkThread())
             {
-                .doorId = "Cubicle Door",
-                .reader = {22, 27},      // DATA0, DATA1
-                .doorSensor = {16, false},      // GPIO16, active high
-                .proximitySensor = {23, true},  // GPIO23, active high
-                .exitButton = {24, true},       // GPIO24, active high
-                .lock = {25, 26}                // GPIO25 (SET), GPIO26 (UNSET)
+                logger->error("Failed to start MQTT network thread");
+                return 1;
             }
-            // Add more doors as needed
-        };
+        }
+        else if (!mqtt->attach(eventLoop))
+        {
+            logger->error("Failed to attach MQTT client to event loop");
+            return 1;
+        }
 
-        // Initialize doors
-        std::vector<std::unique_ptr<Door>> doors;
-        for (const auto& config : doorConfigs)
+        // Credentials are reloaded in place whenever the file changes, and
+        // kept in step with the central server over MQTT
+        auto credentials = std::make_shared<CredentialStore>();
+        if (!credentials->loadFromFile(credentialsPath))
         {
-            auto door = std::make_unique<Door>(config, mqtt);
-            if (!door->initialize())
+            logger->error("No credentials loaded, all card reads will be denied");
+        }
+        credentials->watch(credentialsPath, eventLoop);
+        CredentialSync credentialSync(mqtt, credentials, eventLoop, controllerId);
+
+        // Which levels open which door, and when; schedules can be changed
+        // at runtime over MQTT
+        auto policy = std::make_shared<AccessPolicy>();
+        for (const auto& [name, schedule] : config.schedules)
+        {
+            policy->setSchedule(name, schedule);
+        }
+        ScheduleService scheduleService(mqtt, policy);
+
+        // Binary record of every access decision; doors run without it if
+        // the journal can't be opened
+        std::shared_ptr<AuditJournal> audit;
+        std::unique_ptr<AuditService> auditService;
+        try
+        {
+            AuditJournal::Options auditOptions;
+            auditOptions.directory = journalDirectory;
+            audit = std::make_shared<AuditJournal>(auditOptions);
+            audit->attach(eventLoop);
+            auditService = std::make_unique<AuditService>(mqtt, audit, eventLoop);
+        }
+        catch (const std::exception& e)
+        {
+            logger->error("Audit journal unavailable: {}", e.what());
+            audit.reset();
+        }
+
+        // Latency and throughput metrics go out over MQTT, and to Prometheus
+        // when a scrape port is given
+        MetricsPublisher metricsPublisher(mqtt, eventLoop, metricsTopic);
+        std::unique_ptr<PrometheusEndpoint> prometheus;
+        if (metricsPort > 0)
+        {
+            try
             {
-                logger->error("Failed to initialize door {}", config.doorId);
-                return 1;
+                prometheus = std::make_unique<PrometheusEndpoint>(metricsPort, eventLoop);
+                logger->info("Serving Prometheus metrics on port {}", metricsPort);
+            }
+            catch (const std::exception& e)
+            {
+                logger->error("Prometheus endpoint unavailable: {}", e.what());
             }
-            doors.push_back(std::move(door));
         }
 
-        logger->info("All doors initialized. Running main loop...");
+        // With worker shards, each door's logging and publishing runs on its
+        // shard instead of the event loop
+        if (workerShards > 0)
+        {
+            workers = std::make_shared<WorkerPool>(static_cast<unsigned>(workerShards));
+        }
 
-        // Main loop
-        while (running.load())
+        // Doors tell each other about card decisions and door changes over
+        // an in-process bus; anti-passback follows it when a door needs it
+        auto doorEvents = std::make_shared<DoorEventBus>();
+        std::shared_ptr<AntiPassback> antiPassback;
+        for (const auto& doorConfig : config.doors)
         {
-            mqtt->loop();
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (!doorConfig.antiPassback.area.empty() && !antiPassback)
+            {
+                antiPassback = std::make_shared<AntiPassback>(doorEvents, eventLoop);
+            }
         }
 
-        // Cleanup
-        logger->info("Shutting down...");
-        for (auto& door : doors)
+        // Every door shares one handle per GPIO chip. All doors are constructed
+        // before any is initialized so their lock relays can be requested as
+        // one group.
+        auto gpio = std::make_shared<GpioChipRegistry>(std::make_shared<LibgpiodBackend>());
+        for (const auto& doorConfig : config.doors)
         {
-            door->cleanup();
+            doors.push_back(std::make_unique<Door>(doorConfig, mqtt, eventLoop, gpio, credentials, audit, policy,
+                workers, doorEvents, antiPassback));
         }
+        if (workers)
+        {
+            workers->start();
+        }
+
+        // Doors come up in parallel while the loop already serves the ones
+        // that are ready
+        startup = std::make_unique<DoorStartup>(doors, eventLoop, shutdown, config.onDoorFailure,
+            config.retryInterval);
+        startup->start();
 
+        if (realtimeMode)
+        {
+            realtimeMode->enter();
+            if (!realtimeMode->selfCheck())
+            {
+                logger->warn("Real-time mode is only partly in effect; Wiegand timing may suffer under load");
+            }
+        }
+
+        // Main loop - sleeps until a GPIO edge, MQTT traffic, a timer or a
+        // stop signal needs handling
+        eventLoop->run();
+        eventLoop->remove(shutdown->fd());
+        eventLoop->remove(signalFd);
+        close(signalFd);
+        if (startup->failed())
+        {
+            exitCode = 1;
+        }
     }
     catch (const std::exception& e)
     {
         logger->error("Fatal error: {}", e.what());
-        return 1;
+        exitCode = 1;
+    }
+
+    // Cleanup. Nothing here waits on a timeout: the loop and the worker
+    // shards wake on eventfds, and what's left is the lock relay pulse.
+    logger->info("Shutting down...");
+    auto shutdownStart = std::chrono::steady_clock::now();
+    shutdown->cancel();
+    if (startup)
+    {
+        startup->wait();
+    }
+    Door::cleanupAll(doors);
+    if (workers)
+    {
+        // Publishes what the doors reported last, before they go away
+        workers->stop();
     }
+    logger->info("Shut down in {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - shutdownStart).count());
 
-    return 0;
+    // Everything that may still log goes before the logger does
+    startup.reset();
+    doors.clear();
+    workers.reset();
+    Logger::shutdown();
+    return exitCode;
 }
@@ -1,20 +1,55 @@
 #pragma once
 #include <mosquitto.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <string>
 #include <nlohmann/json.hpp>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
 #include <spdlog/spdlog.h>
+#include "../core/event_loop.hpp"
+#include "../utils/metrics.hpp"
+#include "../utils/payload_writer.hpp"
+#include "publish_queue.hpp"
+#include "topic_router.hpp"
 
 class MqttClient
 {
 public:
+    using MessageHandler = TopicRouter::Handler;
+    using SubscriptionId = TopicRouter::SubscriptionId;
+
+    enum class Qos
+    {
+        AtMostOnce = 0,   // Status snapshots; the next one supersedes a lost one
+        AtLeastOnce = 1   // Access and sensor events, which form the audit trail
+    };
+
+    struct PublishStats
+    {
+        bool connected;
+        size_t queued;          // Waiting for the broker
+        size_t queueHighWater;
+        uint64_t dropped;       // Evicted from a full queue
+        uint64_t replayed;      // Sent from the queue after a reconnect
+        uint64_t reconnects;
+    };
+
     MqttClient(const std::string& clientId,
         const std::string& host = "localhost",
         int port = 1883)
     : clientId_(clientId)
     , host_(host)
     , port_(port)
+    , queue_(kQueueMessages, kQueueArenaBytes)
+    , publishLatency_(Metrics::histogram("mqtt_publish_ns"))
+    , queueLatency_(Metrics::histogram("mqtt_queue_ns"))
+    , sent_(Metrics::counter("mqtt_sent"))
+    , queued_(Metrics::counter("mqtt_queued"))
     {
         mosquitto_lib_init();
         mosq_ = mosquitto_new(clientId_.c_str(), true, this);
@@ -23,51 +58,314 @@ public:
             throw std::runtime_error("Failed to create mosquitto client");
         }
         mosquitto_connect_callback_set(mosq_, onConnect);
+        mosquitto_disconnect_callback_set(mosq_, onDisconnect);
         mosquitto_message_callback_set(mosq_, onMessage);
     }
 
     ~MqttClient()
     {
+        miscTimer_.reset();
+        reconnectTimer_.reset();
+        unwatchSocket();
         if (mosq_)
         {
             mosquitto_disconnect(mosq_);
+            if (networkThread_)
+            {
+                mosquitto_loop_stop(mosq_, false);
+            }
             mosquitto_destroy(mosq_);
         }
+        for (auto& property : contentTypes_)
+        {
+            mosquitto_property_free_all(&property);
+        }
         mosquitto_lib_cleanup();
     }
 
+    // Speak MQTT v5 and tag every publish with the content type of its
+    // payload, so subscribers can tell CBOR or MessagePack from JSON. Needs a
+    // v5 broker (mosquitto 1.6 or later). Call before connect().
+    bool enableContentTypes()
+    {
+        if (mosquitto_int_option(mosq_, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5) != MOSQ_ERR_SUCCESS)
+        {
+            return false;
+        }
+        for (auto format : {PayloadFormat::Json, PayloadFormat::Cbor, PayloadFormat::MessagePack})
+        {
+            auto& property = contentTypes_[static_cast<size_t>(format)];
+            if (mosquitto_property_add_string(&property, MQTT_PROP_CONTENT_TYPE,
+                    payloadContentType(format)) != MOSQ_ERR_SUCCESS)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
     bool connect()
     {
         return mosquitto_connect(mosq_, host_.c_str(), port_, 60) == MOSQ_ERR_SUCCESS;
     }
 
-    bool publish(const std::string& topic, const std::string& message)
+    // Sends right away while connected. Otherwise, or while older messages
+    // are still waiting, the message joins the offline queue and goes out in
+    // order once the broker is back. Returns false only if it was dropped.
+    bool publish(const std::string& topic, std::string_view message,
+        Qos qos = Qos::AtMostOnce, bool retain = false, PayloadFormat format = PayloadFormat::Json)
     {
-        return mosquitto_publish(mosq_, nullptr, topic.c_str(), message.length(),
-                               message.c_str(), 0, false) == MOSQ_ERR_SUCCESS;
+        auto start = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (connected_ && queue_.empty() && send(topic.c_str(), message, static_cast<int>(qos), retain, format))
+        {
+            flushWrites();
+            sent_.add();
+            publishLatency_.recordSince(start);
+            return true;
+        }
+
+        uint64_t dropped = queue_.dropped();
+        bool queued = queue_.push(topic, message, static_cast<int>(qos), retain, format, start);
+        queued_.add();
+        publishLatency_.recordSince(start);
+        if (dropped == droppedReported_ && queue_.dropped() != dropped)
+        {
+            spdlog::warn("MQTT offline queue full, dropping oldest messages");
+        }
+        return queued;
+    }
+
+    PublishStats publishStats()
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        return {connected_, queue_.size(), queue_.highWater(), queue_.dropped(), replayed_, reconnects_};
+    }
+
+    // Deliver messages matching filter ('+' and '#' wildcards allowed) to
+    // handler. Any number of handlers can share the connection; each message
+    // only reaches the ones whose filter matches. The topic and payload views
+    // are only valid for the duration of the call. Handlers must not
+    // subscribe or unsubscribe from inside a callback.
+    SubscriptionId subscribe(const std::string& filter, MessageHandler handler)
+    {
+        std::unique_lock<std::shared_mutex> lock(routerMutex_);
+        SubscriptionId id = router_.add(filter, std::move(handler));
+
+        // Not connected yet: onConnect subscribes to every routed filter
+        if (connected_ && mosquitto_subscribe(mosq_, nullptr, filter.c_str(), 0) != MOSQ_ERR_SUCCESS)
+        {
+            spdlog::warn("MQTT subscribe to {} failed, retrying on reconnect", filter);
+        }
+        return id;
     }
 
-    bool subscribe(const std::string& topic)
+    void unsubscribe(SubscriptionId id)
     {
-        return mosquitto_subscribe(mosq_, nullptr, topic.c_str(), 0) == MOSQ_ERR_SUCCESS;
+        std::unique_lock<std::shared_mutex> lock(routerMutex_);
+        std::string filter;
+        if (router_.remove(id, filter) && connected_)
+        {
+            mosquitto_unsubscribe(mosq_, nullptr, filter.c_str());
+        }
     }
 
-    void setMessageHandler(std::function<void(const std::string&, const std::string&)> handler)
+    // Let the shared event loop drive the connection. The socket is only read
+    // or written when epoll reports it ready, and keepalive/retry housekeeping
+    // runs on a timer, so an idle connection costs one wakeup per second.
+    // Publishing must then happen on the loop thread.
+    // If the broker can't be reached yet, reconnects are retried with
+    // exponential backoff and publishes queue up in the meantime.
+    bool attach(std::shared_ptr<EventLoop> loop)
     {
-        messageHandler_ = std::move(handler);
+        loop_ = loop;
+        miscTimer_ = std::make_unique<TimerWheel::Timer>(loop_->timers(), [this]() { onMiscTimer(); });
+        reconnectTimer_ = std::make_unique<TimerWheel::Timer>(loop_->timers(), [this]() { reconnect(); });
+        miscTimer_->start(kMiscInterval);
+        if (!watchSocket())
+        {
+            scheduleReconnect();
+        }
+        return true;
     }
 
-    void loop()
+    // Alternative to attach(): libmosquitto services the connection on its
+    // own network thread, and publish() may be called from any thread.
+    // Message handlers then run on that network thread.
+    bool startNetworkThread()
     {
-        mosquitto_loop(mosq_, 0, 1);
+        mosquitto_threaded_set(mosq_, true);
+        mosquitto_reconnect_delay_set(mosq_, kReconnectMin.count() / 1000 + 1,
+            kReconnectMax.count() / 1000, true);
+        networkThread_ = mosquitto_loop_start(mosq_) == MOSQ_ERR_SUCCESS;
+        return networkThread_;
     }
 
 private:
+    bool watchSocket()
+    {
+        socketFd_ = mosquitto_socket(mosq_);
+        if (socketFd_ < 0)
+        {
+            return false;
+        }
+        socketEvents_ = EPOLLIN | (mosquitto_want_write(mosq_) ? EPOLLOUT : 0);
+        if (!loop_->add(socketFd_, socketEvents_, [this](uint32_t events) { onSocketEvent(events); }))
+        {
+            socketFd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void unwatchSocket()
+    {
+        if (loop_ && socketFd_ >= 0)
+        {
+            loop_->remove(socketFd_);
+        }
+        socketFd_ = -1;
+    }
+
+    void onSocketEvent(uint32_t events)
+    {
+        int rc = MOSQ_ERR_SUCCESS;
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        {
+            rc = mosquitto_loop_read(mosq_, 1);
+        }
+        if (rc == MOSQ_ERR_SUCCESS && (events & EPOLLOUT))
+        {
+            rc = mosquitto_loop_write(mosq_, 1);
+        }
+
+        if (rc != MOSQ_ERR_SUCCESS)
+        {
+            connectionLost(rc);
+            return;
+        }
+
+        // Replay the offline queue a batch at a time, each batch once the
+        // previous one has been written out
+        if (!mosquitto_want_write(mosq_))
+        {
+            replayQueued(kReplayBatch);
+        }
+        updateSocketEvents();
+    }
+
+    void onMiscTimer()
+    {
+        // A keepalive timeout closes the socket in here. onDisconnect normally
+        // handles it; this catches a close that came without the callback.
+        int rc = mosquitto_loop_misc(mosq_);
+        if (socketFd_ >= 0 && mosquitto_socket(mosq_) < 0)
+        {
+            connectionLost(rc != MOSQ_ERR_SUCCESS ? rc : static_cast<int>(MOSQ_ERR_KEEPALIVE));
+        }
+        updateSocketEvents();
+        miscTimer_->start(kMiscInterval);
+    }
+
+    // Event loop mode: libmosquitto has dropped the connection, so stop
+    // watching its socket, which may already be closed, and start retrying.
+    // Safe to call more than once for the same loss.
+    void connectionLost(int rc)
+    {
+        {
+            std::unique_lock<std::shared_mutex> lock(routerMutex_);
+            connected_ = false;
+        }
+        if (socketFd_ < 0)
+        {
+            return;
+        }
+        spdlog::warn("MQTT connection lost: {}", mosquitto_strerror(rc));
+        unwatchSocket();
+        scheduleReconnect();
+    }
+
+    void scheduleReconnect()
+    {
+        if (reconnectTimer_->pending())
+        {
+            return;
+        }
+        spdlog::info("Reconnecting to MQTT broker in {} ms", reconnectDelay_.count());
+        reconnectTimer_->start(reconnectDelay_);
+        reconnectDelay_ = std::min(reconnectDelay_ * 2, kReconnectMax);
+    }
+
+    void reconnect()
+    {
+        // Non-blocking connect; the socket becomes writable once it completes
+        // and a failure shows up as a read error, which schedules the next try
+        if (mosquitto_reconnect_async(mosq_) != MOSQ_ERR_SUCCESS || !watchSocket())
+        {
+            scheduleReconnect();
+        }
+    }
+
+    bool send(const char* topic, std::string_view payload, int qos, bool retain, PayloadFormat format)
+    {
+        if (const mosquitto_property* contentType = contentTypes_[static_cast<size_t>(format)])
+        {
+            return mosquitto_publish_v5(mosq_, nullptr, topic, static_cast<int>(payload.size()),
+                payload.data(), qos, retain, contentType) == MOSQ_ERR_SUCCESS;
+        }
+        return mosquitto_publish(mosq_, nullptr, topic, static_cast<int>(payload.size()),
+            payload.data(), qos, retain) == MOSQ_ERR_SUCCESS;
+    }
+
+    // Hand up to maxMessages queued publishes to libmosquitto
+    void replayQueued(size_t maxMessages)
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        for (size_t sent = 0; sent < maxMessages && connected_ && !queue_.empty(); sent++)
+        {
+            auto message = queue_.front();
+            if (!send(message.topic.data(), message.payload, message.qos, message.retain, message.format))
+            {
+                return;
+            }
+            queueLatency_.recordSince(message.queuedAt);
+            queue_.pop();
+            replayed_++;
+            sent_.add();
+        }
+    }
+
+    // Write queued packets straight away instead of waiting for the next
+    // EPOLLOUT round trip, and only ask for EPOLLOUT when data is left over
+    void flushWrites()
+    {
+        if (!loop_ || socketFd_ < 0 || !loop_->isInLoopThread())
+        {
+            return;
+        }
+        if (mosquitto_want_write(mosq_) && mosquitto_loop_write(mosq_, 1) != MOSQ_ERR_SUCCESS)
+        {
+            return;  // The read side will notice the broken connection
+        }
+        updateSocketEvents();
+    }
+
+    void updateSocketEvents()
+    {
+        uint32_t wanted = EPOLLIN | (mosquitto_want_write(mosq_) ? EPOLLOUT : 0);
+        if (socketFd_ >= 0 && wanted != socketEvents_ && loop_->modify(socketFd_, wanted))
+        {
+            socketEvents_ = wanted;
+        }
+    }
+
     static void onConnect(struct mosquitto* mosq, void* obj, int rc)
     {
+        auto* client = static_cast<MqttClient*>(obj);
         if (rc == 0)
         {
             spdlog::info("MQTT Connected successfully");
+            client->onConnected();
         }
         else
         {
@@ -75,14 +373,70 @@ private:
         }
     }
 
+    void onConnected()
+    {
+        {
+            // Clean sessions drop subscriptions, so renew them on every connect
+            std::unique_lock<std::shared_mutex> lock(routerMutex_);
+            connected_ = true;
+            for (const auto& filter : router_.filters())
+            {
+                mosquitto_subscribe(mosq_, nullptr, filter.c_str(), 0);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (everConnected_)
+            {
+                reconnects_++;
+            }
+            everConnected_ = true;
+            if (!queue_.empty() || queue_.dropped() != droppedReported_)
+            {
+                spdlog::info("MQTT back online, replaying {} queued messages ({} dropped while offline)",
+                    queue_.size(), queue_.dropped() - droppedReported_);
+            }
+            droppedReported_ = queue_.dropped();
+        }
+
+        if (networkThread_)
+        {
+            // libmosquitto's own thread writes these out as it goes
+            replayQueued(SIZE_MAX);
+        }
+        else
+        {
+            // Called from inside mosquitto_loop_read; onSocketEvent starts
+            // the replay once that returns
+            reconnectDelay_ = kReconnectMin;
+        }
+    }
+
+    static void onDisconnect(struct mosquitto* mosq, void* obj, int rc)
+    {
+        auto* client = static_cast<MqttClient*>(obj);
+        if (client->loop_ && rc != 0)
+        {
+            // Called from inside the loop's own mosquitto calls, e.g. after
+            // a keepalive timeout in mosquitto_loop_misc
+            client->connectionLost(rc);
+            return;
+        }
+        std::unique_lock<std::shared_mutex> lock(client->routerMutex_);
+        client->connected_ = false;
+    }
+
     static void onMessage(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg)
     {
         auto* client = static_cast<MqttClient*>(obj);
-        if (client->messageHandler_)
+        std::string_view topic(msg->topic);
+        std::string_view payload(static_cast<const char*>(msg->payload), msg->payloadlen);
+
+        std::shared_lock<std::shared_mutex> lock(client->routerMutex_);
+        if (client->router_.dispatch(topic, payload) == 0)
         {
-            std::string topic(msg->topic);
-            std::string payload(static_cast<char*>(msg->payload), msg->payloadlen);
-            client->messageHandler_(topic, payload);
+            spdlog::debug("No handler for MQTT message on {}", topic);
         }
     }
 
@@ -90,5 +444,47 @@ private:
     std::string host_;
     int port_;
     struct mosquitto* mosq_;
-    std::function<void(const std::string&, const std::string&)> messageHandler_;
+
+    // Content type property per PayloadFormat; all null unless
+    // enableContentTypes() was called
+    std::array<mosquitto_property*, 3> contentTypes_{};
+
+    // Handlers are added from the main thread and dispatched from whichever
+    // thread services the connection
+    std::shared_mutex routerMutex_;
+    TopicRouter router_;
+    std::atomic<bool> connected_{false};  // Only set while holding routerMutex_
+
+    // Publishes waiting for the broker
+    std::mutex queueMutex_;
+    PublishQueue queue_;
+    uint64_t replayed_{0};
+    uint64_t reconnects_{0};
+    uint64_t droppedReported_{0};
+    bool everConnected_{false};
+
+    // Time spent in publish() including the socket write, and time a
+    // message waited in the queue before libmosquitto took it
+    LatencyHistogram& publishLatency_;
+    LatencyHistogram& queueLatency_;
+    MetricCounter& sent_;
+    MetricCounter& queued_;
+
+    // Event loop mode
+    std::shared_ptr<EventLoop> loop_;
+    std::unique_ptr<TimerWheel::Timer> miscTimer_;
+    std::unique_ptr<TimerWheel::Timer> reconnectTimer_;
+    std::chrono::milliseconds reconnectDelay_{kReconnectMin};
+    int socketFd_{-1};
+    uint32_t socketEvents_{0};
+
+    // Network thread mode
+    bool networkThread_{false};
+
+    static constexpr std::chrono::seconds kMiscInterval{1};
+    static constexpr std::chrono::milliseconds kReconnectMin{500};
+    static constexpr std::chrono::milliseconds kReconnectMax{30000};
+    static constexpr size_t kReplayBatch = 32;
+    static constexpr size_t kQueueMessages = 1024;
+    static constexpr size_t kQueueArenaBytes = 256 * 1024;
 };
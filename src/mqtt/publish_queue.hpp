@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "../utils/payload_writer.hpp"
+
+// Bounded FIFO of publishes waiting for the broker. Topics and payloads are
+// copied back to back into a byte arena allocated once up front, used as a
+// ring, so queueing while offline never allocates. When either the entry
+// ring or the arena is full the oldest message is dropped to make room.
+// Topics are stored NUL-terminated so they can be handed to libmosquitto
+// as they are.
+//
+// Not thread-safe; MqttClient serializes access.
+class PublishQueue
+{
+public:
+    struct Message
+    {
+        std::string_view topic;
+        std::string_view payload;
+        int qos;
+        bool retain;
+        PayloadFormat format;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    PublishQueue(size_t maxMessages, size_t arenaBytes)
+        : entries_(maxMessages)
+        , arena_(arenaBytes)
+    {
+    }
+
+    // Returns false if the message can never fit and was dropped itself
+    bool push(std::string_view topic, std::string_view payload, int qos, bool retain,
+        PayloadFormat format = PayloadFormat::Json,
+        std::chrono::steady_clock::time_point queuedAt = std::chrono::steady_clock::now())
+    {
+        size_t length = topic.size() + 1 + payload.size();
+        if (length > arena_.size() || entries_.empty())
+        {
+            dropped_++;
+            return false;
+        }
+
+        size_t offset;
+        while (!allocate(length, offset))
+        {
+            pop();
+            dropped_++;
+        }
+        if (count_ == entries_.size())
+        {
+            pop();
+            dropped_++;
+        }
+
+        std::copy(topic.begin(), topic.end(), arena_.begin() + offset);
+        arena_[offset + topic.size()] = '\0';
+        std::copy(payload.begin(), payload.end(), arena_.begin() + offset + topic.size() + 1);
+        entries_[(first_ + count_) % entries_.size()] = {offset, static_cast<uint32_t>(topic.size()),
+            static_cast<uint32_t>(payload.size()), static_cast<uint8_t>(qos), retain, format, queuedAt};
+        count_++;
+        tail_ = offset + length;
+        highWater_ = std::max(highWater_, count_);
+        return true;
+    }
+
+    // Oldest message; views stay valid until it is popped
+    Message front() const
+    {
+        const Entry& entry = entries_[first_];
+        const char* base = arena_.data() + entry.offset;
+        return {std::string_view(base, entry.topicLength),
+            std::string_view(base + entry.topicLength + 1, entry.payloadLength), entry.qos, entry.retain,
+            entry.format, entry.queuedAt};
+    }
+
+    void pop()
+    {
+        first_ = (first_ + 1) % entries_.size();
+        if (--count_ == 0)
+        {
+            first_ = 0;
+            tail_ = 0;
+        }
+    }
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    size_t highWater() const { return highWater_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    struct Entry
+    {
+        size_t offset;
+        uint32_t topicLength;
+        uint32_t payloadLength;
+        uint8_t qos;
+        bool retain;
+        PayloadFormat format;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    // Messages sit in the arena in queue order, so the free space is
+    // everything from tail_ up to the oldest message, wrapping at the end
+    bool allocate(size_t length, size_t& offset) const
+    {
+        if (count_ == 0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        size_t head = entries_[first_].offset;
+        if (tail_ > head)
+        {
+            if (tail_ + length <= arena_.size())
+            {
+                offset = tail_;
+                return true;
+            }
+            if (length <= head)
+            {
+                offset = 0;
+                return true;
+            }
+            return false;
+        }
+        if (tail_ < head && tail_ + length <= head)
+        {
+            offset = tail_;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<Entry> entries_;
+    std::vector<char> arena_;
+    size_t first_{0};
+    size_t count_{0};
+    size_t tail_{0};  // End of the newest message in the arena
+    size_t highWater_{0};
+    uint64_t dropped_{0};
+};
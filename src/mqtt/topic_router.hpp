@@ -0,0 +1,222 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Maps MQTT topic filters, including '+' and '#' wildcards, to handlers
+// through a trie with one node per topic level. Dispatching a message walks
+// the topic once, so its cost depends on topic depth and not on how many
+// filters (doors) are registered. Topic and payload are passed through as
+// views; nothing is copied.
+//
+// Not thread-safe on its own; MqttClient serializes access.
+class TopicRouter
+{
+public:
+    using Handler = std::function<void(std::string_view topic, std::string_view payload)>;
+    using SubscriptionId = uint64_t;
+
+    SubscriptionId add(std::string_view filter, Handler handler)
+    {
+        Node* node = &root_;
+        forEachLevel(filter, [&](std::string_view level)
+        {
+            if (level == "+")
+            {
+                node = child(node->singleLevel, level);
+            }
+            else if (level == "#")
+            {
+                node = child(node->multiLevel, level);
+            }
+            else
+            {
+                auto it = node->children.find(level);
+                if (it == node->children.end())
+                {
+                    auto next = std::make_unique<Node>();
+                    next->level = std::string(level);
+                    it = node->children.emplace(next->level, std::move(next)).first;
+                }
+                node = it->second.get();
+            }
+        });
+
+        SubscriptionId id = nextId_++;
+        node->handlers.emplace_back(id, std::move(handler));
+        filters_.emplace_back(id, std::string(filter));
+        return id;
+    }
+
+    // Returns true if the filter has no handlers left
+    bool remove(SubscriptionId id, std::string& filter)
+    {
+        for (auto it = filters_.begin(); it != filters_.end(); ++it)
+        {
+            if (it->first != id)
+            {
+                continue;
+            }
+            filter = std::move(it->second);
+            filters_.erase(it);
+
+            Node* node = find(filter);
+            if (node)
+            {
+                auto& handlers = node->handlers;
+                for (auto h = handlers.begin(); h != handlers.end(); ++h)
+                {
+                    if (h->first == id)
+                    {
+                        handlers.erase(h);
+                        break;
+                    }
+                }
+                return handlers.empty();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Every filter with at least one handler, for resubscribing after a reconnect
+    std::vector<std::string> filters() const
+    {
+        std::vector<std::string> result;
+        for (const auto& [id, filter] : filters_)
+        {
+            bool seen = false;
+            for (const auto& existing : result)
+            {
+                seen = seen || existing == filter;
+            }
+            if (!seen)
+            {
+                result.push_back(filter);
+            }
+        }
+        return result;
+    }
+
+    // Returns the number of handlers the message was delivered to
+    size_t dispatch(std::string_view topic, std::string_view payload) const
+    {
+        // Topics starting with '$' are not matched by a leading wildcard
+        bool system = !topic.empty() && topic[0] == '$';
+        return match(root_, topic, false, system, topic, payload);
+    }
+
+private:
+    struct Node
+    {
+        std::string level;
+        // Keys view the child's own level string, which never moves
+        std::unordered_map<std::string_view, std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> singleLevel;  // '+'
+        std::unique_ptr<Node> multiLevel;   // '#'
+        std::vector<std::pair<SubscriptionId, Handler>> handlers;
+    };
+
+    template <typename Fn>
+    static void forEachLevel(std::string_view topic, Fn&& fn)
+    {
+        while (true)
+        {
+            size_t slash = topic.find('/');
+            fn(topic.substr(0, slash));
+            if (slash == std::string_view::npos)
+            {
+                return;
+            }
+            topic.remove_prefix(slash + 1);
+        }
+    }
+
+    static Node* child(std::unique_ptr<Node>& slot, std::string_view level)
+    {
+        if (!slot)
+        {
+            slot = std::make_unique<Node>();
+            slot->level = std::string(level);
+        }
+        return slot.get();
+    }
+
+    Node* find(std::string_view filter)
+    {
+        Node* node = &root_;
+        forEachLevel(filter, [&](std::string_view level)
+        {
+            if (!node)
+            {
+                return;
+            }
+            if (level == "+")
+            {
+                node = node->singleLevel.get();
+            }
+            else if (level == "#")
+            {
+                node = node->multiLevel.get();
+            }
+            else
+            {
+                auto it = node->children.find(level);
+                node = it == node->children.end() ? nullptr : it->second.get();
+            }
+        });
+        return node;
+    }
+
+    // rest holds the topic levels not consumed yet; end is set once they all are
+    static size_t match(const Node& node, std::string_view rest, bool end, bool skipWildcards,
+        std::string_view topic, std::string_view payload)
+    {
+        size_t delivered = 0;
+
+        // '#' also matches the parent level itself ("a/#" matches "a")
+        if (node.multiLevel && !skipWildcards)
+        {
+            delivered += deliver(*node.multiLevel, topic, payload);
+        }
+
+        if (end)
+        {
+            return delivered + deliver(node, topic, payload);
+        }
+
+        size_t slash = rest.find('/');
+        std::string_view level = rest.substr(0, slash);
+        bool last = slash == std::string_view::npos;
+        std::string_view next = last ? std::string_view() : rest.substr(slash + 1);
+
+        auto it = node.children.find(level);
+        if (it != node.children.end())
+        {
+            delivered += match(*it->second, next, last, false, topic, payload);
+        }
+        if (node.singleLevel && !skipWildcards)
+        {
+            delivered += match(*node.singleLevel, next, last, false, topic, payload);
+        }
+        return delivered;
+    }
+
+    static size_t deliver(const Node& node, std::string_view topic, std::string_view payload)
+    {
+        for (const auto& [id, handler] : node.handlers)
+        {
+            handler(topic, payload);
+        }
+        return node.handlers.size();
+    }
+
+    Node root_;
+    SubscriptionId nextId_{1};
+    std::vector<std::pair<SubscriptionId, std::string>> filters_;
+};
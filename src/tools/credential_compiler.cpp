@@ -0,0 +1,103 @@
+// Compiles a JSON or CSV card list into the binary credential database that
+// door_controller maps at startup, or into the updates the controllers take
+// over MQTT (see CredentialSync).
+//
+//   credential_compiler <input.json|input.csv> <output.db>
+//   credential_compiler --snapshot <input> <version> <output.bin>
+//   credential_compiler --delta <old input> <new input> <old version> <output.bin>
+//
+// Delta and snapshot inputs may also be compiled databases.
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "access/credential_delta.hpp"
+#include "access/credential_table.hpp"
+
+static std::shared_ptr<const CredentialTable> loadTable(const std::string& path)
+{
+    if (CredentialTable::isDatabaseFile(path))
+    {
+        return CredentialTable::mapFile(path);
+    }
+
+    std::ifstream input(path);
+    if (!input)
+    {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    CredentialTable::Builder builder;
+    if (std::filesystem::path(path).extension() == ".csv")
+    {
+        readCredentialsCsv(input, builder);
+    }
+    else
+    {
+        readCredentialsJson(input, builder);
+    }
+    return builder.build();
+}
+
+static void writeUpdate(const CredentialUpdate& update, const std::string& path)
+{
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    std::string encoded = CredentialUpdateCodec::encode(update);
+    output.write(encoded.data(), encoded.size());
+    if (!output)
+    {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    bool snapshot = mode == "--snapshot" && argc == 5;
+    bool delta = mode == "--delta" && argc == 6;
+    if (argc != 3 && !snapshot && !delta)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.json|input.csv> <output.db>\n"
+                  << "       " << argv[0] << " --snapshot <input> <version> <output.bin>\n"
+                  << "       " << argv[0] << " --delta <old input> <new input> <old version> <output.bin>"
+                  << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        if (snapshot)
+        {
+            auto table = loadTable(argv[2]);
+            uint64_t version = std::stoull(argv[3]);
+            writeUpdate(CredentialUpdateCodec::snapshotOf(*table, version), argv[4]);
+            std::cout << "Wrote snapshot " << version << " of " << table->size() << " credentials to "
+                      << argv[4] << std::endl;
+            return 0;
+        }
+        if (delta)
+        {
+            auto from = loadTable(argv[2]);
+            auto to = loadTable(argv[3]);
+            CredentialUpdate update;
+            update.baseVersion = std::stoull(argv[4]);
+            update.version = update.baseVersion + 1;
+            update.changes = CredentialUpdateCodec::diff(*from, *to);
+            writeUpdate(update, argv[5]);
+            std::cout << "Wrote delta " << update.baseVersion << " -> " << update.version << " ("
+                      << update.changes.size() << " changes) to " << argv[5] << std::endl;
+            return 0;
+        }
+
+        std::string outputPath = argv[2];
+        auto table = loadTable(argv[1]);
+        table->writeFile(outputPath);
+        std::cout << "Wrote " << table->size() << " credentials to " << outputPath << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
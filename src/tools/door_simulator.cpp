@@ -0,0 +1,308 @@
+// Runs many virtual doors in one process on the simulated GPIO backend and
+// reports how long the whole pipeline takes, from the last Wiegand edge of a
+// card through decode and the access check to the lock relay and the access
+// event coming back from the broker.
+//
+//   door_simulator [--doors N] [--duration SECONDS] [--interval MS]
+//                  [--host HOST] [--port PORT] [--mqtt-thread] [--workers N]
+//
+// Every door gets one enrolled card, presented every interval with the doors
+// staggered across it, and its door sensor is opened and closed after each
+// grant. The default interval outlasts the relock delay, so every card
+// drives the relay. Access latency needs a broker; without one the doors run
+// offline and only relay latency is measured.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "core/event_loop.hpp"
+#include "core/simulated_gpio_backend.hpp"
+#include "core/worker_pool.hpp"
+#include "door/door.hpp"
+#include "mqtt/mqtt_client.hpp"
+#include "utils/logger.hpp"
+#include "access/credential_store.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    constexpr unsigned int kPinsPerDoor = 8;
+    constexpr uint32_t kFacilityCode = 42;
+
+    struct VirtualDoor
+    {
+        std::string id;
+        unsigned int base;
+        uint64_t card;
+        std::vector<Clock::time_point> frameEnds;  // Fixed before the run starts
+        std::atomic<size_t> accessEvents{0};
+    };
+
+    struct Latencies
+    {
+        std::mutex mutex;
+        std::vector<double> samples;  // Microseconds
+
+        void add(Clock::duration latency)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            samples.push_back(std::chrono::duration<double, std::micro>(latency).count());
+        }
+
+        void print(const char* name)
+        {
+            if (samples.empty())
+            {
+                std::printf("%-8s no samples\n", name);
+                return;
+            }
+            std::sort(samples.begin(), samples.end());
+            auto at = [this](double q) { return samples[std::min(samples.size() - 1, size_t(q * samples.size()))] / 1000.0; };
+            std::printf("%-8s n=%zu p50=%.2fms p99=%.2fms p999=%.2fms max=%.2fms\n",
+                name, samples.size(), at(0.5), at(0.99), at(0.999), samples.back() / 1000.0);
+        }
+    };
+
+    // Latest frame that ended at or before t
+    const Clock::time_point* frameBefore(const VirtualDoor& door, Clock::time_point t)
+    {
+        auto it = std::upper_bound(door.frameEnds.begin(), door.frameEnds.end(), t);
+        return it == door.frameEnds.begin() ? nullptr : &*(it - 1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int doorCount = 200;
+    int durationSeconds = 30;
+    int intervalMs = 6000;
+    std::string host = "localhost";
+    int port = 1883;
+    bool mqttNetworkThread = false;
+    int workerShards = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--doors" && hasValue)
+        {
+            doorCount = std::atoi(argv[++i]);
+        }
+        else if (arg == "--duration" && hasValue)
+        {
+            durationSeconds = std::atoi(argv[++i]);
+        }
+        else if (arg == "--interval" && hasValue)
+        {
+            intervalMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--host" && hasValue)
+        {
+            host = argv[++i];
+        }
+        else if (arg == "--port" && hasValue)
+        {
+            port = std::atoi(argv[++i]);
+        }
+        else if (arg == "--mqtt-thread")
+        {
+            mqttNetworkThread = true;
+        }
+        else if (arg == "--workers" && hasValue)
+        {
+            workerShards = std::atoi(argv[++i]);
+            mqttNetworkThread = true;  // Shards publish
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--doors N] [--duration SECONDS] [--interval MS] "
+                "[--host HOST] [--port PORT] [--mqtt-thread] [--workers N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (doorCount == 0 || doorCount > 65535 || durationSeconds <= 0 || intervalMs <= 0 || workerShards < 0)
+    {
+        std::fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    // Hundreds of doors logging every card would measure the logger; keep
+    // the output to the summary
+    LogOptions logOptions;
+    logOptions.console = false;
+    logOptions.directory.clear();
+    Logger::initializeGlobal(logOptions);
+
+    try
+    {
+        auto loop = std::make_shared<EventLoop>();
+        auto backend = std::make_shared<SimulatedGpioBackend>();
+        auto gpio = std::make_shared<GpioChipRegistry>(backend);
+
+        auto mqtt = std::make_shared<MqttClient>("door_simulator", host, port);
+        bool online = mqtt->connect();
+        if (!online)
+        {
+            std::printf("No broker at %s:%d, running offline\n", host.c_str(), port);
+        }
+        if (mqttNetworkThread ? !mqtt->startNetworkThread() : !mqtt->attach(loop))
+        {
+            std::fprintf(stderr, "Failed to start MQTT client\n");
+            return 1;
+        }
+
+        // One enrolled H10301 card per door
+        std::vector<std::unique_ptr<VirtualDoor>> virtualDoors;
+        CredentialTable::Builder builder;
+        for (unsigned int i = 0; i < doorCount; i++)
+        {
+            auto door = std::make_unique<VirtualDoor>();
+            char id[16];
+            std::snprintf(id, sizeof(id), "sim-%04u", i);
+            door->id = id;
+            door->base = i * kPinsPerDoor;
+            door->card = Wiegand26::encode(kFacilityCode, i);
+            builder.add(door->card, ~AccessMask{0}, door->id);
+            virtualDoors.push_back(std::move(door));
+        }
+        auto credentials = std::make_shared<CredentialStore>();
+        credentials->replace(builder.build());
+
+        Latencies relay;
+        Latencies access;
+
+        // Relay: the unlock line of a door going high
+        backend->onOutputChange([&](const std::string&, unsigned int offset, int value)
+        {
+            unsigned int index = offset / kPinsPerDoor;
+            if (value != 1 || offset % kPinsPerDoor != 6 || index >= virtualDoors.size())
+            {
+                return;
+            }
+            auto now = Clock::now();
+            if (const Clock::time_point* frameEnd = frameBefore(*virtualDoors[index], now))
+            {
+                relay.add(now - *frameEnd);
+            }
+        });
+
+        std::shared_ptr<WorkerPool> workers;
+        if (workerShards > 0)
+        {
+            workers = std::make_shared<WorkerPool>(static_cast<unsigned>(workerShards));
+        }
+
+        // Pull-up inputs idle high, so every sensor is wired active low
+        std::vector<std::unique_ptr<Door>> doors;
+        for (const auto& virtualDoor : virtualDoors)
+        {
+            unsigned int base = virtualDoor->base;
+            DoorConfig config
+            {
+                .doorId = virtualDoor->id,
+                .reader = {base, base + 1},
+                .doorSensor = {base + 2, false},
+                .proximitySensor = {base + 3, false},
+                .exitButton = {base + 4, false},
+                .lock = {base + 5, base + 6}
+            };
+            doors.push_back(std::make_unique<Door>(config, mqtt, loop, gpio, credentials, nullptr,
+                std::make_shared<AccessPolicy>(), workers));
+        }
+        if (workers)
+        {
+            workers->start();
+        }
+        for (auto& door : doors)
+        {
+            if (!door->initialize())
+            {
+                std::fprintf(stderr, "Failed to initialize door %s\n", door->id().c_str());
+                return 1;
+            }
+        }
+
+        // Access: our own access events echoed back by the broker, in order per door
+        auto accessSubscription = mqtt->subscribe("access/+", [&](std::string_view topic, std::string_view)
+        {
+            auto now = Clock::now();
+            unsigned int index = std::atoi(std::string(topic.substr(topic.rfind('-') + 1)).c_str());
+            if (index >= virtualDoors.size())
+            {
+                return;
+            }
+            VirtualDoor& door = *virtualDoors[index];
+            size_t event = door.accessEvents++;
+            if (event < door.frameEnds.size())
+            {
+                access.add(now - door.frameEnds[event]);
+            }
+        });
+
+        // Schedule every card and door movement up front; the injector
+        // delivers each edge at its exact time
+        auto start = Clock::now() + std::chrono::seconds(1);
+        auto end = start + std::chrono::seconds(durationSeconds);
+        auto interval = std::chrono::milliseconds(intervalMs);
+        size_t cards = 0;
+        for (unsigned int i = 0; i < doorCount; i++)
+        {
+            VirtualDoor& door = *virtualDoors[i];
+            for (auto at = start + interval * i / doorCount; at < end; at += interval)
+            {
+                auto frameEnd = backend->injectWiegand(GpioChipRegistry::kDefaultChip,
+                    door.base, door.base + 1, door.card, 26, at);
+                door.frameEnds.push_back(frameEnd);
+                backend->pulse(GpioChipRegistry::kDefaultChip, door.base + 2, 0,
+                    std::chrono::seconds(2), frameEnd + std::chrono::milliseconds(500));
+                cards++;
+            }
+        }
+
+        // Let the last frames and relay pulses finish before stopping
+        TimerWheel::Timer stopTimer(loop->timers(), [&]() { loop->stop(); });
+        stopTimer.start(std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - Clock::now() + std::chrono::seconds(1)));
+
+        std::printf("Simulating %u doors for %d s, one card per door every %d ms\n",
+            doorCount, durationSeconds, intervalMs);
+        loop->run();
+        mqtt->unsubscribe(accessSubscription);
+        Door::cleanupAll(doors);
+        if (workers)
+        {
+            workers->stop();
+        }
+
+        size_t accessEvents = 0;
+        for (const auto& door : virtualDoors)
+        {
+            accessEvents += door->accessEvents;
+        }
+        auto stats = mqtt->publishStats();
+        std::printf("cards=%zu access_events=%zu throughput=%.1f cards/s queued=%zu dropped=%llu\n",
+            cards, accessEvents, double(cards) / durationSeconds,
+            stats.queued, static_cast<unsigned long long>(stats.dropped));
+        std::printf("Latency from the last edge of a card; includes the 50 ms inter-frame gap\n");
+        relay.print("relay");
+        if (online)
+        {
+            access.print("access");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        Logger::shutdown();
+        return 1;
+    }
+
+    Logger::shutdown();
+    return 0;
+}
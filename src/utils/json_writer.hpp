@@ -0,0 +1,115 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Writes a JSON object straight into a caller-owned buffer. Meant for the
+// small fixed-shape messages published on every event, where building an
+// nlohmann::json tree first would allocate for every field. The buffer is
+// cleared but keeps its capacity, so reusing one per publisher means
+// serializing doesn't allocate once it has grown to size.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string& out)
+        : out_(out)
+    {
+        out_.clear();
+        out_ += '{';
+    }
+
+    JsonWriter& field(std::string_view key, std::string_view value)
+    {
+        writeKey(key);
+        writeString(value);
+        return *this;
+    }
+
+    JsonWriter& field(std::string_view key, const char* value)
+    {
+        return field(key, std::string_view(value ? value : ""));
+    }
+
+    JsonWriter& field(std::string_view key, bool value)
+    {
+        writeKey(key);
+        out_ += value ? "true" : "false";
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    JsonWriter& field(std::string_view key, Integer value)
+    {
+        writeKey(key);
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out_.append(digits, result.ptr);
+        return *this;
+    }
+
+    // Fields written until the matching endObject() go into a nested object
+    JsonWriter& beginObject(std::string_view key)
+    {
+        writeKey(key);
+        out_ += '{';
+        needComma_ = false;
+        return *this;
+    }
+
+    JsonWriter& endObject()
+    {
+        out_ += '}';
+        needComma_ = true;
+        return *this;
+    }
+
+    // Close the top-level object; the view is into the caller's buffer
+    std::string_view finish()
+    {
+        out_ += '}';
+        return out_;
+    }
+
+private:
+    void writeKey(std::string_view key)
+    {
+        if (needComma_)
+        {
+            out_ += ',';
+        }
+        needComma_ = true;
+        writeString(key);
+        out_ += ':';
+    }
+
+    void writeString(std::string_view value)
+    {
+        static constexpr char kHex[] = "0123456789abcdef";
+        out_ += '"';
+        for (char c : value)
+        {
+            auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                out_ += '\\';
+                out_ += c;
+            }
+            else if (byte < 0x20)
+            {
+                out_ += "\\u00";
+                out_ += kHex[byte >> 4];
+                out_ += kHex[byte & 0xf];
+            }
+            else
+            {
+                out_ += c;
+            }
+        }
+        out_ += '"';
+    }
+
+    std::string& out_;
+    bool needComma_{false};
+};
@@ -1,25 +1,100 @@
 #pragma once
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <memory>
+#include <string>
+#include <vector>
 
+struct LogOptions
+{
+    bool console{true};
+    std::string directory{"logs"};      // Empty disables per-door log files
+    size_t maxFileSize{5 * 1024 * 1024};
+    size_t maxFiles{3};
+
+    // Messages waiting for the logging thread. Once full, the oldest are
+    // overwritten instead of stalling the event loop, unless blockWhenFull.
+    size_t queueSize{8192};
+    bool blockWhenFull{false};
+};
+
+// Every logger is asynchronous: a log call only formats the message and
+// queues it, and a single background thread does the console and file I/O.
+// Door loggers write to the shared console sink and their own rotating
+// file, so one call per event reaches both.
+//
+// Verbose output should use the SPDLOG_LOGGER_DEBUG/SPDLOG_LOGGER_TRACE
+// macros; below the compile-time SPDLOG_ACTIVE_LEVEL they and their
+// arguments compile to nothing.
 class Logger
 {
 public:
+    // Call once at startup before anything logs. Installs and returns the
+    // default logger.
+    static std::shared_ptr<spdlog::logger> initializeGlobal(const LogOptions& options = {})
+    {
+        options_ = options;
+        spdlog::init_thread_pool(options_.queueSize, 1);
+        if (options_.console)
+        {
+            consoleSink_ = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        }
+
+        std::vector<spdlog::sink_ptr> sinks;
+        if (consoleSink_)
+        {
+            sinks.push_back(consoleSink_);
+        }
+        auto logger = makeLogger("console", sinks);
+        spdlog::set_default_logger(logger);
+        return logger;
+    }
+
     static void initialize(const std::string& doorId)
     {
-        auto doorLogger = spdlog::rotating_logger_mt(
-            "door_" + doorId,
-            "logs/door_" + doorId + ".log",
-            1024 * 1024 * 5,  // 5MB max file size
-            3                 // Keep 3 old files
-        );
-        doorLogger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] %v");
+        std::vector<spdlog::sink_ptr> sinks;
+        if (consoleSink_)
+        {
+            sinks.push_back(consoleSink_);
+        }
+        if (!options_.directory.empty())
+        {
+            auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+                options_.directory + "/door_" + doorId + ".log",
+                options_.maxFileSize,
+                options_.maxFiles);
+            fileSink->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] %v");
+            sinks.push_back(fileSink);
+        }
+        makeLogger("door_" + doorId, sinks);
     }
 
     static std::shared_ptr<spdlog::logger> getDoorLogger(const std::string& doorId)
     {
         return spdlog::get("door_" + doorId);
     }
+
+    // Flush whatever is still queued and stop the logging thread
+    static void shutdown()
+    {
+        spdlog::shutdown();
+    }
+
+private:
+    static std::shared_ptr<spdlog::logger> makeLogger(const std::string& name, const std::vector<spdlog::sink_ptr>& sinks)
+    {
+        auto policy = options_.blockWhenFull
+            ? spdlog::async_overflow_policy::block
+            : spdlog::async_overflow_policy::overrun_oldest;
+        auto logger = std::make_shared<spdlog::async_logger>(
+            name, sinks.begin(), sinks.end(), spdlog::thread_pool(), policy);
+        logger->set_level(spdlog::level::level_enum(SPDLOG_ACTIVE_LEVEL));
+        spdlog::register_logger(logger);
+        return logger;
+    }
+
+    static inline LogOptions options_;
+    static inline spdlog::sink_ptr consoleSink_;
 };
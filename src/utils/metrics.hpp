@@ -0,0 +1,520 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "json_writer.hpp"
+
+// Thread-sharded recording. Each thread writes to its own shard, so a record
+// is one uncontended relaxed atomic add and never takes a lock; readers sum
+// the shards.
+namespace metrics_detail
+{
+    constexpr unsigned kMaxShards = 8;
+
+    inline unsigned threadShard()
+    {
+        static std::atomic<unsigned> nextThread{0};
+        thread_local unsigned shard = nextThread++ % kMaxShards;
+        return shard;
+    }
+}
+
+// Monotonic event count
+class MetricCounter
+{
+public:
+    void add(uint64_t n = 1)
+    {
+        shards_[metrics_detail::threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const
+    {
+        uint64_t total = 0;
+        for (const auto& shard : shards_)
+        {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, metrics_detail::kMaxShards> shards_;
+};
+
+// Current level of something, such as a queue depth; the last write wins
+class MetricGauge
+{
+public:
+    void set(int64_t value)
+    {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    int64_t value() const
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: every power of
+// two is split into 16 linear buckets, so any value is placed within about
+// 6% across the whole range (1 ns to about 68 s; longer values are clamped).
+// A thread's shard is allocated on its first record.
+class LatencyHistogram
+{
+public:
+    struct Snapshot
+    {
+        uint64_t count{0};
+        uint64_t sumNs{0};
+        uint64_t maxNs{0};
+        std::vector<uint64_t> buckets;
+
+        // Value at quantile q (0..1), reported as the middle of its bucket
+        uint64_t percentile(double q) const
+        {
+            if (count == 0)
+            {
+                return 0;
+            }
+            uint64_t rank = static_cast<uint64_t>(q * count);
+            rank = rank < 1 ? 1 : (rank > count ? count : rank);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); i++)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                {
+                    uint64_t low = bucketLow(i);
+                    uint64_t value = low + (bucketLow(i + 1) - low) / 2;
+                    return value < maxNs ? value : maxNs;
+                }
+            }
+            return maxNs;
+        }
+    };
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    ~LatencyHistogram()
+    {
+        for (auto& shard : shards_)
+        {
+            delete shard.load();
+        }
+    }
+
+    void record(uint64_t ns)
+    {
+        Shard& shard = threadShard();
+        shard.buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = shard.max.load(std::memory_order_relaxed);
+        while (ns > max && !shard.max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    void record(std::chrono::steady_clock::duration elapsed)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        record(static_cast<uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    void recordSince(std::chrono::steady_clock::time_point start)
+    {
+        record(std::chrono::steady_clock::now() - start);
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.buckets.assign(kBuckets, 0);
+        for (const auto& slot : shards_)
+        {
+            const Shard* shard = slot.load(std::memory_order_acquire);
+            if (!shard)
+            {
+                continue;
+            }
+            for (size_t i = 0; i < kBuckets; i++)
+            {
+                uint64_t n = shard->buckets[i].load(std::memory_order_relaxed);
+                snapshot.buckets[i] += n;
+                snapshot.count += n;
+            }
+            snapshot.sumNs += shard->sum.load(std::memory_order_relaxed);
+            uint64_t max = shard->max.load(std::memory_order_relaxed);
+            snapshot.maxNs = max > snapshot.maxNs ? max : snapshot.maxNs;
+        }
+        return snapshot;
+    }
+
+private:
+    static constexpr unsigned kSubBits = 4;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBits;
+    static constexpr unsigned kMaxExponent = 36;
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+    struct Shard
+    {
+        std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    static size_t bucketIndex(uint64_t ns)
+    {
+        if (ns < kSubBuckets)
+        {
+            return ns;
+        }
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        if (exponent > kMaxExponent)
+        {
+            return kBuckets - 1;
+        }
+        unsigned shift = exponent - kSubBits;
+        return (shift + 1) * kSubBuckets + ((ns >> shift) & (kSubBuckets - 1));
+    }
+
+    // Smallest value that lands in bucket index
+    static uint64_t bucketLow(size_t index)
+    {
+        if (index < kSubBuckets)
+        {
+            return index;
+        }
+        unsigned shift = static_cast<unsigned>(index / kSubBuckets) - 1;
+        return (kSubBuckets + index % kSubBuckets) << shift;
+    }
+
+    Shard& threadShard()
+    {
+        auto& slot = shards_[metrics_detail::threadShard()];
+        Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard)
+        {
+            auto fresh = std::make_unique<Shard>();
+            if (slot.compare_exchange_strong(shard, fresh.get(), std::memory_order_acq_rel))
+            {
+                shard = fresh.release();
+            }
+        }
+        return *shard;
+    }
+
+    std::array<std::atomic<Shard*>, metrics_detail::kMaxShards> shards_{};
+};
+
+// A label other than door on a process-wide metric, e.g. {"area", "Lab"}
+struct MetricLabel
+{
+    std::string name;
+    std::string value;
+};
+
+// Process-wide registry of named metrics, optionally labelled with a door.
+// Components look their metrics up once at construction and keep the
+// reference; lookups take a lock, recording never does. Metrics live for the
+// rest of the process.
+//
+// Latency histograms are in nanoseconds and named *_ns.
+class Metrics
+{
+public:
+    static LatencyHistogram& histogram(const std::string& name, const std::string& door = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto& entry = histograms()[doorKey(name, door)];
+        if (!entry)
+        {
+            entry = std::make_unique<LatencyHistogram>();
+        }
+        return *entry;
+    }
+
+    static MetricCounter& counter(const std::string& name, const std::string& door = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto& entry = counters()[doorKey(name, door)];
+        if (!entry)
+        {
+            entry = std::make_unique<MetricCounter>();
+        }
+        return *entry;
+    }
+
+    static MetricGauge& gauge(const std::string& name, const std::string& door = "")
+    {
+        return findGauge(doorKey(name, door));
+    }
+
+    // A process-wide gauge with its own label instead of a door's
+    static MetricGauge& gauge(const std::string& name, const MetricLabel& label)
+    {
+        return findGauge(Key{name, label.name, label.value});
+    }
+
+    // Metrics labelled with door, or the process-wide ones for an empty door,
+    // as one JSON object:
+    //   {"door_id": "...", "counters": {...}, "gauges": {...},
+    //    "histograms": {"lock_relay_ns": {"count": ..., "p50": ..., ...}}}
+    // Process-wide gauges with a label of their own are grouped by it, e.g.
+    // "gauges": {"area_occupancy": {"Lab": 3, "Lobby": 0}}.
+    static std::string_view writeJson(const std::string& door, std::string& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        JsonWriter json(out);
+        json.field("door_id", door);
+        json.beginObject("counters");
+        for (const auto& [key, counter] : counters())
+        {
+            if (key == doorKey(key.name, door))
+            {
+                json.field(key.name, counter->value());
+            }
+        }
+        json.endObject();
+        json.beginObject("gauges");
+        std::string group;  // Name of the labelled gauge being written
+        for (const auto& [key, gauge] : gauges())
+        {
+            bool labelled = door.empty() && !key.label.empty() && key.label != kDoorLabel;
+            if (!group.empty() && (!labelled || key.name != group))
+            {
+                json.endObject();
+                group.clear();
+            }
+            if (labelled)
+            {
+                if (group.empty())
+                {
+                    group = key.name;
+                    json.beginObject(group);
+                }
+                json.field(key.value, gauge->value());
+            }
+            else if (key == doorKey(key.name, door))
+            {
+                json.field(key.name, gauge->value());
+            }
+        }
+        if (!group.empty())
+        {
+            json.endObject();
+        }
+        json.endObject();
+        json.beginObject("histograms");
+        for (const auto& [key, histogram] : histograms())
+        {
+            if (!(key == doorKey(key.name, door)))
+            {
+                continue;
+            }
+            auto snapshot = histogram->snapshot();
+            json.beginObject(key.name)
+                .field("count", snapshot.count)
+                .field("sum", snapshot.sumNs)
+                .field("p50", snapshot.percentile(0.5))
+                .field("p90", snapshot.percentile(0.9))
+                .field("p99", snapshot.percentile(0.99))
+                .field("p999", snapshot.percentile(0.999))
+                .field("max", snapshot.maxNs)
+                .endObject();
+        }
+        json.endObject();
+        return json.finish();
+    }
+
+    // Every metric in the Prometheus text exposition format. Counters get a
+    // _total suffix; histograms become summaries in seconds.
+    static std::string writePrometheus()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::string out;
+        std::string family;
+        for (const auto& [key, counter] : counters())
+        {
+            if (key.name != family)
+            {
+                family = key.name;
+                out += "# TYPE door_" + family + "_total counter\n";
+            }
+            out += "door_" + key.name + "_total" + labels(key, nullptr) + " " +
+                std::to_string(counter->value()) + "\n";
+        }
+
+        family.clear();
+        for (const auto& [key, gauge] : gauges())
+        {
+            if (key.name != family)
+            {
+                family = key.name;
+                out += "# TYPE door_" + family + " gauge\n";
+            }
+            out += "door_" + key.name + labels(key, nullptr) + " " + std::to_string(gauge->value()) + "\n";
+        }
+
+        family.clear();
+        for (const auto& [key, histogram] : histograms())
+        {
+            std::string name = "door_" + secondsName(key.name);
+            if (key.name != family)
+            {
+                family = key.name;
+                out += "# TYPE " + name + " summary\n";
+            }
+            auto snapshot = histogram->snapshot();
+            for (const char* quantile : {"0.5", "0.9", "0.99", "0.999"})
+            {
+                out += name + labels(key, quantile) + " " +
+                    seconds(snapshot.percentile(std::stod(quantile))) + "\n";
+            }
+            out += name + "_sum" + labels(key, nullptr) + " " + seconds(snapshot.sumNs) + "\n";
+            out += name + "_count" + labels(key, nullptr) + " " + std::to_string(snapshot.count) + "\n";
+        }
+        return out;
+    }
+
+    // Doors that have at least one metric
+    static std::vector<std::string> doors()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::vector<std::string> doors;
+        auto addDoor = [&doors](const Key& key)
+        {
+            if (key.label == kDoorLabel && (doors.empty() || doors.back() != key.value))
+            {
+                doors.push_back(key.value);
+            }
+        };
+        for (const auto& entry : counters()) addDoor(entry.first);
+        for (const auto& entry : gauges()) addDoor(entry.first);
+        for (const auto& entry : histograms()) addDoor(entry.first);
+        std::sort(doors.begin(), doors.end());
+        doors.erase(std::unique(doors.begin(), doors.end()), doors.end());
+        return doors;
+    }
+
+private:
+    static constexpr const char* kDoorLabel = "door";
+
+    struct Key
+    {
+        std::string name;
+        std::string label;  // Label name; empty for an unlabelled metric
+        std::string value;
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(name, label, value) < std::tie(other.name, other.label, other.value);
+        }
+
+        bool operator==(const Key& other) const
+        {
+            return std::tie(name, label, value) == std::tie(other.name, other.label, other.value);
+        }
+    };
+
+    static Key doorKey(const std::string& name, const std::string& door)
+    {
+        return door.empty() ? Key{name, "", ""} : Key{name, kDoorLabel, door};
+    }
+
+    static MetricGauge& findGauge(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto& entry = gauges()[key];
+        if (!entry)
+        {
+            entry = std::make_unique<MetricGauge>();
+        }
+        return *entry;
+    }
+
+    static std::mutex& mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::map<Key, std::unique_ptr<LatencyHistogram>>& histograms()
+    {
+        static std::map<Key, std::unique_ptr<LatencyHistogram>> histograms;
+        return histograms;
+    }
+
+    static std::map<Key, std::unique_ptr<MetricCounter>>& counters()
+    {
+        static std::map<Key, std::unique_ptr<MetricCounter>> counters;
+        return counters;
+    }
+
+    static std::map<Key, std::unique_ptr<MetricGauge>>& gauges()
+    {
+        static std::map<Key, std::unique_ptr<MetricGauge>> gauges;
+        return gauges;
+    }
+
+    // lock_relay_ns -> lock_relay_seconds
+    static std::string secondsName(const std::string& name)
+    {
+        std::string_view base(name);
+        if (base.size() > 3 && base.substr(base.size() - 3) == "_ns")
+        {
+            base.remove_suffix(3);
+        }
+        return std::string(base) + "_seconds";
+    }
+
+    static std::string seconds(uint64_t ns)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.9f", ns / 1e9);
+        return buf;
+    }
+
+    static std::string labels(const Key& key, const char* quantile)
+    {
+        std::string out;
+        if (!key.label.empty())
+        {
+            out += key.label + "=\"";
+            for (char c : key.value)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                }
+                out += c == '\n' ? ' ' : c;
+            }
+            out += "\"";
+        }
+        if (quantile)
+        {
+            out += std::string(out.empty() ? "" : ",") + "quantile=\"" + quantile + "\"";
+        }
+        return out.empty() ? out : "{" + out + "}";
+    }
+};
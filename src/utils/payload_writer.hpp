@@ -0,0 +1,337 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "json_writer.hpp"
+
+// Encoding of the event payloads published over MQTT, chosen per deployment
+enum class PayloadFormat : uint8_t
+{
+    Json,
+    Cbor,
+    MessagePack
+};
+
+inline bool parsePayloadFormat(std::string_view name, PayloadFormat& format)
+{
+    if (name == "json") format = PayloadFormat::Json;
+    else if (name == "cbor") format = PayloadFormat::Cbor;
+    else if (name == "msgpack") format = PayloadFormat::MessagePack;
+    else return false;
+    return true;
+}
+
+// MQTT v5 content type of each format
+inline const char* payloadContentType(PayloadFormat format)
+{
+    switch (format)
+    {
+    case PayloadFormat::Cbor: return "application/cbor";
+    case PayloadFormat::MessagePack: return "application/msgpack";
+    default: return "application/json";
+    }
+}
+
+// A payload as it can go in a log line: binary payloads are only named
+inline std::string_view loggablePayload(std::string_view payload, PayloadFormat format)
+{
+    switch (format)
+    {
+    case PayloadFormat::Cbor: return "(CBOR)";
+    case PayloadFormat::MessagePack: return "(MessagePack)";
+    default: return payload;
+    }
+}
+
+// JsonWriter's interface for every PayloadFormat. The binary formats encode
+// the same object, keys and all, so any generic CBOR or MessagePack decoder
+// reads it; the saving is in the framing and in numbers and booleans taking
+// one to nine bytes. Map sizes aren't known until an object is closed, so a
+// one-byte header is reserved and patched then, growing only for objects of
+// more than 15 fields. Like JsonWriter, it writes into a reused buffer.
+class PayloadWriter
+{
+public:
+    PayloadWriter(std::string& out, PayloadFormat format)
+        : out_(out)
+        , format_(format)
+    {
+        if (format_ == PayloadFormat::Json)
+        {
+            json_.emplace(out_);
+            return;
+        }
+        out_.clear();
+        openMap();
+    }
+
+    PayloadWriter& field(std::string_view key, std::string_view value)
+    {
+        if (json_)
+        {
+            json_->field(key, value);
+            return *this;
+        }
+        writeKey(key);
+        writeString(value);
+        return *this;
+    }
+
+    PayloadWriter& field(std::string_view key, const char* value)
+    {
+        return field(key, std::string_view(value ? value : ""));
+    }
+
+    PayloadWriter& field(std::string_view key, bool value)
+    {
+        if (json_)
+        {
+            json_->field(key, value);
+            return *this;
+        }
+        writeKey(key);
+        if (format_ == PayloadFormat::Cbor)
+        {
+            out_ += static_cast<char>(value ? 0xf5 : 0xf4);
+        }
+        else
+        {
+            out_ += static_cast<char>(value ? 0xc3 : 0xc2);
+        }
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    PayloadWriter& field(std::string_view key, Integer value)
+    {
+        if (json_)
+        {
+            json_->field(key, value);
+            return *this;
+        }
+        writeKey(key);
+        if constexpr (std::is_signed_v<Integer>)
+        {
+            if (value < 0)
+            {
+                writeNegative(static_cast<int64_t>(value));
+                return *this;
+            }
+        }
+        writeUnsigned(static_cast<uint64_t>(value));
+        return *this;
+    }
+
+    PayloadWriter& beginObject(std::string_view key)
+    {
+        if (json_)
+        {
+            json_->beginObject(key);
+            return *this;
+        }
+        writeKey(key);
+        openMap();
+        return *this;
+    }
+
+    PayloadWriter& endObject()
+    {
+        if (json_)
+        {
+            json_->endObject();
+            return *this;
+        }
+        closeMap();
+        return *this;
+    }
+
+    // Close the top-level object; the view is into the caller's buffer
+    std::string_view finish()
+    {
+        if (json_)
+        {
+            return json_->finish();
+        }
+        closeMap();
+        return out_;
+    }
+
+private:
+    struct OpenMap
+    {
+        size_t header;    // Offset of the reserved header byte
+        uint32_t fields;
+    };
+
+    void openMap()
+    {
+        maps_[depth_++] = {out_.size(), 0};
+        out_ += '\0';
+    }
+
+    void closeMap()
+    {
+        const OpenMap& map = maps_[--depth_];
+        auto* header = reinterpret_cast<unsigned char*>(&out_[map.header]);
+        if (format_ == PayloadFormat::Cbor)
+        {
+            if (map.fields < 24)
+            {
+                *header = static_cast<unsigned char>(0xa0 | map.fields);
+                return;
+            }
+            *header = 0xb9;  // 16-bit length
+        }
+        else
+        {
+            if (map.fields < 16)
+            {
+                *header = static_cast<unsigned char>(0x80 | map.fields);
+                return;
+            }
+            *header = 0xde;  // map16
+        }
+        char size[2] = {static_cast<char>(map.fields >> 8), static_cast<char>(map.fields)};
+        out_.insert(map.header + 1, size, sizeof(size));
+    }
+
+    void writeKey(std::string_view key)
+    {
+        maps_[depth_ - 1].fields++;
+        writeString(key);
+    }
+
+    void writeString(std::string_view value)
+    {
+        size_t size = value.size();
+        if (format_ == PayloadFormat::Cbor)
+        {
+            writeCborHead(0x60, size);
+        }
+        else if (size < 32)
+        {
+            out_ += static_cast<char>(0xa0 | size);
+        }
+        else if (size <= UINT8_MAX)
+        {
+            out_ += static_cast<char>(0xd9);
+            writeBigEndian(size, 1);
+        }
+        else if (size <= UINT16_MAX)
+        {
+            out_ += static_cast<char>(0xda);
+            writeBigEndian(size, 2);
+        }
+        else
+        {
+            out_ += static_cast<char>(0xdb);
+            writeBigEndian(size, 4);
+        }
+        out_.append(value);
+    }
+
+    void writeUnsigned(uint64_t value)
+    {
+        if (format_ == PayloadFormat::Cbor)
+        {
+            writeCborHead(0x00, value);
+        }
+        else if (value < 128)
+        {
+            out_ += static_cast<char>(value);  // Positive fixint
+        }
+        else
+        {
+            writeMessagePackSized(value, 0xcc);
+        }
+    }
+
+    void writeNegative(int64_t value)
+    {
+        if (format_ == PayloadFormat::Cbor)
+        {
+            writeCborHead(0x20, static_cast<uint64_t>(-1 - value));
+        }
+        else if (value >= -32)
+        {
+            out_ += static_cast<char>(value);  // Negative fixint
+        }
+        else if (value >= INT8_MIN)
+        {
+            out_ += static_cast<char>(0xd0);
+            writeBigEndian(static_cast<uint64_t>(value), 1);
+        }
+        else if (value >= INT16_MIN)
+        {
+            out_ += static_cast<char>(0xd1);
+            writeBigEndian(static_cast<uint64_t>(value), 2);
+        }
+        else if (value >= INT32_MIN)
+        {
+            out_ += static_cast<char>(0xd2);
+            writeBigEndian(static_cast<uint64_t>(value), 4);
+        }
+        else
+        {
+            out_ += static_cast<char>(0xd3);
+            writeBigEndian(static_cast<uint64_t>(value), 8);
+        }
+    }
+
+    // CBOR major type with its argument in the fewest bytes
+    void writeCborHead(uint8_t major, uint64_t value)
+    {
+        if (value < 24)
+        {
+            out_ += static_cast<char>(major | value);
+        }
+        else if (value <= UINT8_MAX)
+        {
+            out_ += static_cast<char>(major | 24);
+            writeBigEndian(value, 1);
+        }
+        else if (value <= UINT16_MAX)
+        {
+            out_ += static_cast<char>(major | 25);
+            writeBigEndian(value, 2);
+        }
+        else if (value <= UINT32_MAX)
+        {
+            out_ += static_cast<char>(major | 26);
+            writeBigEndian(value, 4);
+        }
+        else
+        {
+            out_ += static_cast<char>(major | 27);
+            writeBigEndian(value, 8);
+        }
+    }
+
+    // MessagePack uint8/16/32/64, whose type bytes follow on from first
+    void writeMessagePackSized(uint64_t value, uint8_t first)
+    {
+        size_t bytes = value <= UINT8_MAX ? 1 : value <= UINT16_MAX ? 2 : value <= UINT32_MAX ? 4 : 8;
+        uint8_t step = bytes == 1 ? 0 : bytes == 2 ? 1 : bytes == 4 ? 2 : 3;
+        out_ += static_cast<char>(first + step);
+        writeBigEndian(value, bytes);
+    }
+
+    void writeBigEndian(uint64_t value, size_t bytes)
+    {
+        for (size_t i = bytes; i-- > 0;)
+        {
+            out_ += static_cast<char>(value >> (8 * i));
+        }
+    }
+
+    static constexpr size_t kMaxDepth = 4;
+
+    std::string& out_;
+    PayloadFormat format_;
+    std::optional<JsonWriter> json_;
+    std::array<OpenMap, kMaxDepth> maps_{};
+    size_t depth_{0};
+};
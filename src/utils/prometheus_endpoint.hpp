@@ -0,0 +1,167 @@
+#pragma once
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "../core/event_loop.hpp"
+#include "metrics.hpp"
+
+// Minimal HTTP endpoint for Prometheus to scrape. Every request, whatever its
+// path, gets the current metrics in the text exposition format and the
+// connection is closed. Runs on the event loop; sockets never block it.
+class PrometheusEndpoint
+{
+public:
+    PrometheusEndpoint(uint16_t port, std::shared_ptr<EventLoop> loop)
+        : loop_(loop)
+    {
+        listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0)
+        {
+            throw std::runtime_error("Failed to create metrics socket");
+        }
+
+        int reuse = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listenFd_, kBacklog) < 0 ||
+            !loop_->add(listenFd_, EPOLLIN, [this](uint32_t) { acceptClients(); }))
+        {
+            close(listenFd_);
+            throw std::runtime_error("Failed to listen for metrics on port " + std::to_string(port));
+        }
+    }
+
+    ~PrometheusEndpoint()
+    {
+        for (const auto& client : clients_)
+        {
+            loop_->remove(client.first);
+            close(client.first);
+        }
+        loop_->remove(listenFd_);
+        close(listenFd_);
+    }
+
+    PrometheusEndpoint(const PrometheusEndpoint&) = delete;
+    PrometheusEndpoint& operator=(const PrometheusEndpoint&) = delete;
+
+private:
+    struct Client
+    {
+        std::string request;
+        std::string response;  // Set once the request is complete
+        size_t written{0};
+    };
+
+    void acceptClients()
+    {
+        int fd;
+        while ((fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            if (clients_.size() >= kMaxClients || !loop_->add(fd, EPOLLIN, [this, fd](uint32_t events) { service(fd, events); }))
+            {
+                close(fd);
+                continue;
+            }
+            clients_[fd];
+        }
+    }
+
+    void service(int fd, uint32_t events)
+    {
+        auto it = clients_.find(fd);
+        if (it == clients_.end())
+        {
+            return;
+        }
+        Client& client = it->second;
+
+        if (client.response.empty())
+        {
+            if (!readRequest(fd, client))
+            {
+                disconnect(fd);
+                return;
+            }
+            if (client.response.empty())
+            {
+                return;
+            }
+        }
+        else if (events & (EPOLLERR | EPOLLHUP))
+        {
+            disconnect(fd);
+            return;
+        }
+
+        // Write what the socket takes; wait for EPOLLOUT for the rest
+        while (client.written < client.response.size())
+        {
+            ssize_t n = send(fd, client.response.data() + client.written,
+                client.response.size() - client.written, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    loop_->modify(fd, EPOLLOUT);
+                    return;
+                }
+                break;
+            }
+            client.written += n;
+        }
+        disconnect(fd);
+    }
+
+    // False if the client went away or sent too much. Builds the response
+    // once the request headers are complete.
+    bool readRequest(int fd, Client& client)
+    {
+        char buf[1024];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+        {
+            client.request.append(buf, n);
+            if (client.request.size() > kMaxRequest)
+            {
+                return false;
+            }
+        }
+        bool closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        if (client.request.find("\r\n\r\n") == std::string::npos)
+        {
+            return !closed;
+        }
+
+        std::string body = Metrics::writePrometheus();
+        client.response = "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+        return true;
+    }
+
+    void disconnect(int fd)
+    {
+        loop_->remove(fd);
+        close(fd);
+        clients_.erase(fd);
+    }
+
+    static constexpr int kBacklog = 8;
+    static constexpr size_t kMaxClients = 16;
+    static constexpr size_t kMaxRequest = 8192;
+
+    std::shared_ptr<EventLoop> loop_;
+    int listenFd_{-1};
+    std::map<int, Client> clients_;
+};